@@ -64,8 +64,10 @@ gamRat="${GAM_RAT}"
   } || :
 } || gamCnm='0'
 gamAfc='afade=t=in:d='"${GAM_FID}"','
+gamEnl=''
 [ "${gamOpr}" == 'endless' ] && {
-  gamLoc=-1 || :
+  gamLoc=-1
+  gamEnl='-e' || :
 } || {
   (( gamLen / GAM_LOT < GAM_RAT - 1 )) && {
     gamLoc=1
@@ -83,6 +85,6 @@ gamAfc+='aresample='"${gamRat}"' * 2:filter_size=0:phase_shift=0,'
 gamAfc+='channelmap='"${gamCnm}"','
 gamAfc+='lowpass='"${gamLpc}"':p=1,lowpass='"${gamLpc}"':p=1,'
 echo 'Now playing in '"${gamOpr}"' mode.'
-"${GAM_DEC}" -p 0 -l "${gamLoc}" -o '-' "${1}" | ffplay -autoexit -loglevel \
-    'warning' -f "${gamFmt}" -ac "${gamCnl}" -ar "${gamRat}" -af \
+"${GAM_DEC}" -p 0 -l "${gamLoc}" ${gamEnl} -o '-' "${1}" | ffplay -autoexit \
+    -loglevel 'warning' -f "${gamFmt}" -ac "${gamCnl}" -ar "${gamRat}" -af \
     "${gamAfc:0:-1}" '-' && echo 'Done.'
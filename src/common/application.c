@@ -5,6 +5,8 @@
  */
 #define APPLICATION_FFLUSH_EBADF
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "application.h"
 #include "constants.h"
 #include "strings.h"
@@ -126,20 +128,23 @@ bool application_print_message(const char *restrict head,
 }
 
 bool application_print_strings(int count, const char *restrict string, ...) {
-  if (fputs(string, APPLICATION_FILE_PRINT) == EOF) {
-    return false;
-  }
+#ifndef _WIN32
+  // Kept whole among threads.
+  flockfile(APPLICATION_FILE_PRINT);
+#endif
+  bool out = fputs(string, APPLICATION_FILE_PRINT) != EOF;
   count--;
   va_list strings;
   va_start(strings, string);
-  bool out = true;
-  while (count-- > 0) {
+  while (out && count-- > 0) {
     if (fputs(va_arg(strings, char *), APPLICATION_FILE_PRINT) == EOF) {
       out = false;
-      break;
     }
   }
   va_end(strings);
+#ifndef _WIN32
+  funlockfile(APPLICATION_FILE_PRINT);
+#endif
   return out;
 }
 
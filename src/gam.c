@@ -1,10 +1,273 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "gam.h"
 #include "common/application.h"
 #include "common/constants.h"
 #include "common/strings.h"
 #include "gapcm/gapcm.h"
+#include "gapcm/io.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+/** Batch loop cache capacity in memory in bytes, shared among workers. */
+#define GAM_BATCH_CACHE_BYTES (256 * 1024 * 1024)
+/** Count of files kept from batch workers, such as the standard streams. */
+#define GAM_BATCH_FILES_RESERVED 16
+/**
+ * Count of files a batch task holds open at most: its source, its output, a
+ * loop cache spill, and an io_uring instance for each stream.
+ */
+#define GAM_BATCH_TASK_FILES 5
+
+/** Represents a batch task: a source to run, to an output if templated. */
+struct GamBatchTask {
+  /** Output stream name. NULL without a batch template. */
+  char *output;
+  /** Source stream name. */
+  char *source;
+  /** Source size in bytes. */
+  unsigned long long size;
+  /** Failed before running? */
+  bool failed;
+};
+
+/** Represents a batch: its tasks and the workers running them. */
+struct GamBatch {
+  /** Instance whose options the tasks take. */
+  const struct GamInstance *instance;
+  /** Operation functions run for each task. */
+  int (*READ)(struct GamInstance *);
+  int (*ACT)(struct GamInstance *);
+  int (*DONE)(struct GamInstance *);
+  /** Tasks, biggest source first. */
+  struct GamBatchTask *tasks;
+  /** Count of tasks. */
+  size_t count;
+  /** Capacity of tasks. */
+  size_t capacity;
+  /** Loop cache capacity in memory of each worker in bytes. */
+  size_t cache;
+#ifdef _WIN32
+  /** Index of the next task to take. */
+  size_t next;
+  /** Count of tasks failed. */
+  size_t failures;
+#else
+  /** Index of the next task to take. */
+  atomic_size_t next;
+  /** Count of tasks failed. */
+  atomic_size_t failures;
+#endif
+};
+
+static int gam_run_mode(struct GamInstance *i, enum GamMode mode,
+                        struct GamOption **o, const size_t count,
+                        int (*help)(void), int (*read)(struct GamInstance *),
+                        int (*act)(struct GamInstance *),
+                        int (*done)(struct GamInstance *));
+
+/** Returns a copy of the given string. */
+static char *gam_string_copy(const char *string) {
+  char *out = malloc(strlen(string) + 1);
+  strcpy(out, string);
+  return out;
+}
+
+/** Adds a task for the given source of the given size to the given batch. */
+static void gam_batch_push(struct GamBatch *b, const char *source,
+                           const unsigned long long size) {
+  if (b->count == b->capacity) {
+    b->capacity = b->capacity == 0 ? 64 : b->capacity * 2;
+    b->tasks = realloc(b->tasks, sizeof(*b->tasks) * b->capacity);
+  }
+  struct GamBatchTask *task = &b->tasks[b->count++];
+  task->output = NULL;
+  task->source = gam_string_copy(source);
+  task->size = size;
+  task->failed = false;
+}
+
+/**
+ * Returns whether the given file name ends with the given extension, ignoring
+ * case. NULL matches any.
+ */
+static bool gam_batch_match(const char *name, const char *extension) {
+  if (extension == NULL) {
+    return true;
+  }
+  size_t counts[] = {strlen(name), strlen(extension)};
+  if (counts[0] <= counts[1]) {
+    return false;
+  }
+  name = &name[counts[0] - counts[1]];
+  for (size_t index = 0; index < counts[1]; index++) {
+    if (tolower((unsigned char)name[index]) !=
+        tolower((unsigned char)extension[index])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Adds the given source to the given batch, or the files in it if a directory,
+ * and returns its success. Files in directories are added if regular, not
+ * hidden, and named with the extension of the batch instance if any.
+ */
+static bool gam_batch_add(struct GamBatch *b, const char *source) {
+  struct stat status;
+  if (stat(source, &status) != SUCCESS) {
+    application_print_message(source, strerror(errno));
+    return false;
+  }
+  if (!S_ISDIR(status.st_mode)) {
+    gam_batch_push(b, source, status.st_size);
+    return true;
+  }
+  DIR *directory = opendir(source);
+  if (directory == NULL) {
+    application_print_message(source, strerror(errno));
+    return false;
+  }
+  size_t count = strlen(source);
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.' || !gam_batch_match(name, b->instance->extension)) {
+      continue;
+    }
+    char *path = malloc(count + strlen(name) + 2);
+    strcpy(path, source);
+    if (source[count - 1] != '/') {
+      strcat(path, "/");
+    }
+    strcat(path, name);
+    if (stat(path, &status) == SUCCESS && S_ISREG(status.st_mode)) {
+      gam_batch_push(b, path, status.st_size);
+    }
+    free(path);
+  }
+  closedir(directory);
+  return true;
+}
+
+/** Orders batch tasks by output name. */
+static int gam_batch_compare_output(const void *a, const void *b) {
+  const struct GamBatchTask *const *tasks[] = {a, b};
+  return strcmp((*tasks[0])->output, (*tasks[1])->output);
+}
+
+/** Orders batch tasks biggest source first, then by source name. */
+static int gam_batch_compare_size(const void *a, const void *b) {
+  const struct GamBatchTask *tasks[] = {a, b};
+  if (tasks[0]->size != tasks[1]->size) {
+    return tasks[0]->size < tasks[1]->size ? 1 : -1;
+  }
+  return strcmp(tasks[0]->source, tasks[1]->source);
+}
+
+/**
+ * Expands the given output template for the given source name: `%d` to its
+ * directory, `%f` to its file name, `%n` to its file name without extension,
+ * and `%%` to `%`.
+ */
+static char *gam_batch_output(const char *template, const char *source) {
+  const char *name = strrchr(source, '/');
+  name = name == NULL ? source : &name[1];
+  const char *extension = strrchr(name, '.');
+  size_t counts[] = {name == source ? 1 : (size_t)(name - source - 1),
+                     strlen(name),
+                     extension == NULL || extension == name
+                         ? strlen(name)
+                         : (size_t)(extension - name)};
+  if (name != source && counts[0] == 0) {
+    // Root directory.
+    counts[0] = 1;
+  }
+  size_t count = 1;
+  for (const char *c = template; *c != '\0'; c++) {
+    count += c[0] == '%' && c[1] != '\0' ? counts[0] + counts[1] : 1;
+  }
+  char *out = malloc(count);
+  char *o = out;
+  for (const char *c = template; *c != '\0'; c++) {
+    if (c[0] != '%' || c[1] == '\0') {
+      *o++ = *c;
+      continue;
+    }
+    switch (*++c) {
+    case 'd':
+      memcpy(o, name == source ? "." : source, counts[0]);
+      o += counts[0];
+      break;
+    case 'f':
+      memcpy(o, name, counts[1]);
+      o += counts[1];
+      break;
+    case 'n':
+      memcpy(o, name, counts[2]);
+      o += counts[2];
+      break;
+    default:
+      *o++ = *c;
+    }
+  }
+  *o = '\0';
+  return out;
+}
+
+/** Runs the given batch task and returns its success. */
+static int gam_batch_run(const struct GamBatch *b,
+                         const struct GamBatchTask *task) {
+  if (task->failed) {
+    return EXIT_FAILURE;
+  }
+  struct GamInstance *i = gam_instance_make(NULL, 0);
+  struct GamOptions *o = i->options;
+  *o = *b->instance->options;
+  o->batch = NULL;
+  o->cache = b->cache;
+  o->has_batch = false;
+  o->output = task->output == NULL ? NULL : gam_string_copy(task->output);
+  o->source = gam_string_copy(task->source);
+  o->sources = NULL;
+  o->source_count = 0;
+  o->threads = 1;
+  int out = gam_run_mode(i, READ, NULL, 0, NULL, b->READ, b->ACT, b->DONE);
+  i = gam_instance_free(i);
+  return out;
+}
+
+/** Runs tasks of the given batch until none are left. */
+static void *gam_batch_worker(void *user) {
+  struct GamBatch *b = user;
+  size_t index;
+#ifdef _WIN32
+  while ((index = b->next++) < b->count) {
+#else
+  while ((index = atomic_fetch_add(&b->next, 1)) < b->count) {
+#endif
+    if (gam_batch_run(b, &b->tasks[index]) != EXIT_SUCCESS) {
+#ifdef _WIN32
+      b->failures++;
+#else
+      atomic_fetch_add(&b->failures, 1);
+#endif
+    }
+  }
+  return NULL;
+}
 
 static int gam_parse_bool(struct ApplicationParseContext *c, bool *present) {
   // Wunused-parameter
@@ -42,6 +305,123 @@ static int gam_parse_u8s(struct ApplicationParseContext *c, uint8_t *integers,
   return out;
 }
 
+int gam_batch(struct GamInstance *i, int (*read)(struct GamInstance *),
+              int (*act)(struct GamInstance *),
+              int (*done)(struct GamInstance *)) {
+  struct GamBatch batch = {.instance = i,
+                           .READ = read,
+                           .ACT = act,
+                           .DONE = done,
+                           .tasks = NULL,
+                           .count = 0,
+                           .capacity = 0,
+                           .next = 0,
+                           .failures = 0};
+  struct GamOptions *o = i->options;
+  size_t failures = 0;
+  for (size_t index = 0; index < o->source_count; index++) {
+    if (string_equals(o->sources[index], APPLICATION_FILE_NAME_STANDARD)) {
+      failures++;
+      application_print_message(o->sources[index],
+                                "Standard streams are unavailable in batch.");
+    } else if (!gam_batch_add(&batch, o->sources[index])) {
+      failures++;
+    }
+  }
+  if (batch.count > 0) {
+    qsort(batch.tasks, batch.count, sizeof(*batch.tasks),
+          gam_batch_compare_size);
+  }
+  // Outputs shared or overwriting a source fail before any is written.
+  struct GamBatchTask **tasks = malloc(sizeof(*tasks) * (batch.count + 1));
+  for (size_t index = 0; index < batch.count; index++) {
+    tasks[index] = &batch.tasks[index];
+    if (o->batch != NULL) {
+      tasks[index]->output = gam_batch_output(o->batch, tasks[index]->source);
+    }
+  }
+  if (batch.count > 0 && o->batch != NULL) {
+    qsort(tasks, batch.count, sizeof(*tasks), gam_batch_compare_output);
+  }
+  for (size_t index = 0; index < batch.count && o->batch != NULL; index++) {
+    struct GamBatchTask *task = tasks[index];
+    const char *error = NULL;
+    if (string_equals(task->output, APPLICATION_FILE_NAME_STANDARD)) {
+      error = "Standard streams are unavailable in batch.";
+    } else if (string_equals(task->output, task->source)) {
+      error = "Output is the source.";
+    } else if ((index > 0 &&
+                string_equals(task->output, tasks[index - 1]->output)) ||
+               (index + 1 < batch.count &&
+                string_equals(task->output, tasks[index + 1]->output))) {
+      error = "Output is shared with another source.";
+    }
+    if (error != NULL) {
+      application_print_message(task->source, error);
+      task->failed = true;
+    }
+  }
+  free(tasks);
+  size_t count_source = batch.count + failures;
+  size_t count = o->has_threads ? o->threads : 0;
+#ifdef _WIN32
+  count = 1;
+#else
+  if (count == 0) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    count = processors > 0 ? processors : 1;
+  }
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == SUCCESS &&
+      limit.rlim_cur != RLIM_INFINITY) {
+    rlim_t files = limit.rlim_cur > GAM_BATCH_FILES_RESERVED
+                       ? limit.rlim_cur - GAM_BATCH_FILES_RESERVED
+                       : 0;
+    if (count > files / GAM_BATCH_TASK_FILES) {
+      count = files / GAM_BATCH_TASK_FILES;
+    }
+  }
+#endif
+  if (count > batch.count) {
+    count = batch.count;
+  }
+  if (count < 1) {
+    count = 1;
+  }
+  batch.cache = GAM_BATCH_CACHE_BYTES / count;
+#ifdef _WIN32
+  gam_batch_worker(&batch);
+#else
+  // The calling thread works too, so each spawn failure costs one worker.
+  pthread_t *threads = malloc(sizeof(*threads) * count);
+  size_t count_thread = 0;
+  while (count_thread + 1 < count &&
+         pthread_create(&threads[count_thread], NULL, gam_batch_worker,
+                        &batch) == SUCCESS) {
+    count_thread++;
+  }
+  gam_batch_worker(&batch);
+  while (count_thread > 0) {
+    pthread_join(threads[--count_thread], NULL);
+  }
+  free(threads);
+#endif
+  failures += batch.failures;
+  for (size_t index = 0; index < batch.count; index++) {
+    free(batch.tasks[index].output);
+    free(batch.tasks[index].source);
+  }
+  free(batch.tasks);
+  if (failures > 0) {
+    char string[64];
+    snprintf(string, sizeof(string), "%zu of %zu sources failed.", failures,
+             count_source);
+    application_print_message(i->name, string);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
 bool gam_check_files(struct GamInstance *i, int *success) {
   *success = EXIT_SUCCESS;
   if (ferror(i->source) != SUCCESS) {
@@ -71,6 +451,17 @@ struct GamInstance *gam_instance_free(struct GamInstance *i) {
   i->header = gapcm_header_free(i->header);
   i->options = gam_options_free(i->options);
   i->parse = application_parsecontext_free(i->parse);
+#ifndef _WIN32
+  gapcm_io_memory_unmap(i->map);
+#endif
+  free(i->map);
+#ifdef __linux__
+  i->pipe = gapcm_io_pipe_free(i->pipe);
+  for (size_t index = 0; index < 2; index++) {
+    i->urings[index] = gapcm_io_uring_free(i->urings[index]);
+  }
+#endif
+  i->session = gapcm_session_free(i->session);
   free(i);
   return NULL;
 }
@@ -78,12 +469,19 @@ struct GamInstance *gam_instance_free(struct GamInstance *i) {
 struct GamInstance *gam_instance_make(char *arguments[], int count) {
   struct GamInstance *out = malloc(sizeof(*out));
   out->header = gapcm_header_make();
+  out->map = calloc(1, sizeof(*out->map));
   out->options = gam_options_make();
   out->output = NULL;
   out->parse = application_parsecontext_make(arguments, count);
+  out->pipe = NULL;
+  out->urings[0] = NULL;
+  out->urings[1] = NULL;
   out->read_count = 0;
+  out->session = NULL;
   out->source = NULL;
   out->write_count = 0;
+  out->extension = NULL;
+  out->name = NULL;
   return out;
 }
 
@@ -115,6 +513,7 @@ struct GamOption *gam_option_make(
 }
 
 struct GamOptions *gam_options_free(struct GamOptions *o) {
+  free(o->batch);
   free(o->output);
   free(o->source);
   free(o);
@@ -123,18 +522,32 @@ struct GamOptions *gam_options_free(struct GamOptions *o) {
 
 struct GamOptions *gam_options_make(void) {
   struct GamOptions *out = calloc(1, sizeof(*out));
+  out->batch = NULL;
+  out->format = NULL;
   out->output = NULL;
   out->source = NULL;
+  out->sources = NULL;
+  out->cache = 0;
+  out->source_count = 0;
+  out->endless = false;
   out->has_channels = false;
   out->has_echo_delay = false;
   out->has_echo_levels = false;
   out->has_echo_pans = false;
+  out->has_batch = false;
   out->has_echo_pregap = false;
+  out->has_end = false;
   out->has_length = false;
   out->has_loop = false;
   out->has_mark = false;
   out->has_pregap = false;
+  out->has_start = false;
+  out->has_threads = false;
   out->info = false;
+  out->pipeline = false;
+  out->reflink = false;
+  out->threads = 1;
+  out->uring = false;
   out->trail = false;
   return out;
 }
@@ -150,6 +563,9 @@ int gam_parse(struct ApplicationParseContext *c, struct GamOption **cases,
         c->out = help();
       } else if (string_equals(c->option, "--")) {
         c->parse_options = false;
+      } else if (options->has_batch && c->option[0] != '-') {
+        // Batch sources start here.
+        break;
       } else if (c->index < c->COUNT) {
         c->out = application_error_option_bad(c->option);
       } else {
@@ -164,10 +580,26 @@ int gam_parse(struct ApplicationParseContext *c, struct GamOption **cases,
     options->source =
         malloc(sizeof(*options->source) * (strlen(c->option) + 1));
     strcpy(options->source, c->option);
+    if (options->has_batch) {
+      options->sources = &c->arguments[c->index - 1];
+      options->source_count = c->COUNT - c->index + 1;
+    }
   }
   return c->out;
 }
 
+int gam_parse_batch(struct ApplicationParseContext *c,
+                    struct GamOptions *options) {
+  int out = application_parse_string(c, &options->batch);
+  options->has_batch = out == EXIT_SUCCESS;
+  if (out == EXIT_SUCCESS && strstr(options->batch, "%f") == NULL &&
+      strstr(options->batch, "%n") == NULL) {
+    out = application_error_argument_bad(c->option, options->batch,
+                                         "No `%f` or `%n`.");
+  }
+  return out;
+}
+
 int gam_parse_channels(struct ApplicationParseContext *c,
                        struct GamOptions *options) {
   long long number;
@@ -199,11 +631,34 @@ int gam_parse_echo_pregap(struct ApplicationParseContext *c,
   return gam_parse_u8(c, &options->echo_pregap, &options->has_echo_pregap);
 }
 
+int gam_parse_endless(struct ApplicationParseContext *c,
+                      struct GamOptions *options) {
+  return gam_parse_bool(c, &options->endless);
+}
+
 int gam_parse_info(struct ApplicationParseContext *c,
                    struct GamOptions *options) {
   return gam_parse_bool(c, &options->info);
 }
 
+int gam_parse_io(struct ApplicationParseContext *c,
+                 struct GamOptions *options) {
+  char *argument = NULL;
+  int out = application_parse_string(c, &argument);
+  if (out == EXIT_SUCCESS) {
+    if (string_equals(argument, GAM_IO_URING)) {
+      options->uring = true;
+    } else if (string_equals(argument, GAM_IO_STDIO)) {
+      options->uring = false;
+    } else {
+      out = application_error_argument_bad(
+          c->option, argument, "Not `" GAM_IO_STDIO "` or `" GAM_IO_URING "`.");
+    }
+  }
+  free(argument);
+  return out;
+}
+
 int gam_parse_length(struct ApplicationParseContext *c,
                      struct GamOptions *options) {
   long long number;
@@ -229,6 +684,20 @@ int gam_parse_mark(struct ApplicationParseContext *c,
 bool gam_parse_option(struct ApplicationParseContext *c,
                       struct GamOption **cases, const size_t count,
                       struct GamOptions *options) {
+  char *argument = strchr(c->option, '=');
+  if (argument != NULL && strncmp(c->option, "--", 2) == 0) {
+    // Swapped in place to `argument\0name\0` to keep it freeable as one.
+    size_t count_name = argument - c->option;
+    size_t count_argument = strlen(&argument[1]) + 1;
+    char *name = malloc(count_name);
+    memcpy(name, c->option, count_name);
+    memmove(c->option, &argument[1], count_argument);
+    memcpy(&c->option[count_argument], name, count_name);
+    c->option[count_argument + count_name] = '\0';
+    free(name);
+    c->arguments[--c->index] = c->option;
+    c->option = &c->option[count_argument];
+  }
   for (size_t index = 0; index < count; index++) {
     if (string_equals_any(c->option, 2, cases[index]->NAME,
                           cases[index]->NAME_LONG)) {
@@ -244,21 +713,76 @@ int gam_parse_output(struct ApplicationParseContext *c,
   return application_parse_string(c, &options->output);
 }
 
+int gam_parse_pipeline(struct ApplicationParseContext *c,
+                       struct GamOptions *options) {
+  return gam_parse_bool(c, &options->pipeline);
+}
+
 int gam_parse_pregap(struct ApplicationParseContext *c,
                      struct GamOptions *options) {
   return gam_parse_u8(c, &options->pregap, &options->has_pregap);
 }
 
+int gam_parse_reflink(struct ApplicationParseContext *c,
+                      struct GamOptions *options) {
+  return gam_parse_bool(c, &options->reflink);
+}
+
+int gam_parse_threads(struct ApplicationParseContext *c,
+                      struct GamOptions *options) {
+  long long number;
+  int out = application_parse_integer(c, &number, 0, 1024, "[0, 1024]");
+  if (out == EXIT_SUCCESS) {
+    options->threads = number;
+    options->has_threads = true;
+  }
+  return out;
+}
+
 int gam_parse_trail(struct ApplicationParseContext *c,
                     struct GamOptions *options) {
   return gam_parse_bool(c, &options->trail);
 }
 
+#ifdef __linux__
+const struct GaPcmIo *gam_uring(struct GamInstance *i, struct GaPcmIo *io,
+                                const bool output) {
+  FILE *file = output ? i->output : i->source;
+  if (i->options->uring && (!output || fflush(file) == SUCCESS)) {
+    long long offset = ftello(file);
+    if (offset >= 0) {
+      i->urings[output] = gapcm_io_uring_make(fileno(file), offset, output);
+    }
+    if (i->urings[output] != NULL) {
+      return gapcm_io_uring(io, i->urings[output]);
+    }
+  }
+  return NULL;
+}
+
+bool gam_uring_flush(struct GamInstance *i, int *success) {
+  if (i->urings[1] != NULL && !gapcm_io_uring_flush(i->urings[1]) &&
+      *success == EXIT_SUCCESS) {
+    *success = EXIT_FAILURE;
+    application_print_message(i->options->output, GAM_ERROR_WRITE);
+  }
+  return *success == EXIT_SUCCESS;
+}
+#endif
+
 int gam_run(struct GamInstance *i, struct GamOption **o, const size_t count,
             int (*help)(void), int (*read)(struct GamInstance *),
             int (*act)(struct GamInstance *),
             int (*done)(struct GamInstance *)) {
-  enum GamMode mode = PARSE;
+  return gam_run_mode(i, PARSE, o, count, help, read, act, done);
+}
+
+/** Runs the given instance from the given operation mode. See `gam_run`. */
+static int gam_run_mode(struct GamInstance *i, enum GamMode mode,
+                        struct GamOption **o, const size_t count,
+                        int (*help)(void), int (*read)(struct GamInstance *),
+                        int (*act)(struct GamInstance *),
+                        int (*done)(struct GamInstance *)) {
   int out = EXIT_FAILURE;
   do {
     switch (mode) {
@@ -267,6 +791,9 @@ int gam_run(struct GamInstance *i, struct GamOption **o, const size_t count,
       mode = READ;
       break;
     case READ:
+      if (i->options->sources != NULL) {
+        return gam_batch(i, read, act, done);
+      }
       out = read(i);
       mode = ACT;
       break;
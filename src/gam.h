@@ -18,15 +18,21 @@
 #define GAM_ERROR_READ "A read error has occurred."
 #define GAM_ERROR_WRITE "A write error has occurred."
 #define GAM_INFO_LISTEN "Now listening from pipe."
+#define GAM_IO_STDIO "stdio"
+#define GAM_IO_URING "uring"
 
 /** Exit code: quit. */
 #define GAM_EXIT_QUIT 0xcdda
 /** Preset loop count. */
 #define GAM_LOOP_COUNT 2
+/** Nominal sample rate in Hz for times in seconds. */
+#define GAM_RATE 16276
 
 /** Operation modes. */
 enum GamMode { PARSE, READ, ACT, DONE };
 
+struct GaPcmIo;
+
 /** Represents an instance. */
 struct GamInstance {
   /** GAPCM header. */
@@ -35,6 +41,14 @@ struct GamInstance {
   struct GamOptions *options;
   /** Parse context. */
   struct ApplicationParseContext *parse;
+  /** Source stream mapping. Unmapped if its bytes are NULL. */
+  struct GaPcmIoMemory *map;
+  /** Output pipe. NULL if written through the output stream. */
+  struct GaPcmIoPipe *pipe;
+  /** Transcoding session. */
+  struct GaPcmSession *session;
+  /** io_uring source and output streams. NULL where unused. */
+  struct GaPcmIoUring *urings[2];
   /** Output stream. */
   FILE *output;
   /** Source stream. */
@@ -43,6 +57,13 @@ struct GamInstance {
   unsigned long long read_count;
   /** Count of bytes written. */
   unsigned long long write_count;
+  /**
+   * File name extension of batch sources listed from directories. NULL for
+   * any.
+   */
+  const char *extension;
+  /** Application name for messages. */
+  const char *name;
 };
 
 /** Represents an option case. */
@@ -61,10 +82,24 @@ struct GamOptions {
   uint8_t echo_levels[3];
   /** Echo pans. */
   uint8_t echo_pans[6];
+  /** Record format. NULL for none. */
+  const char *format;
+  /** Batch output template. NULL outside batch mode. */
+  char *batch;
   /** Output stream. */
   char *output;
   /** Source stream. */
   char *source;
+  /** Batch sources within the parse context. NULL outside batch mode. */
+  char **sources;
+  /** Loop cache capacity in memory in bytes. `0` for default. */
+  size_t cache;
+  /** Count of batch sources. */
+  size_t source_count;
+  /** End frame. */
+  unsigned long long end;
+  /** Start frame. */
+  unsigned long long start;
   /** Length frames. */
   uint32_t length;
   /** Mark blocks. */
@@ -73,12 +108,18 @@ struct GamOptions {
   uint16_t channels;
   /** Loop count. */
   uint16_t loop;
+  /** Thread count. `0` for one per processor. */
+  uint16_t threads;
   /** Echo delay ticks. */
   uint8_t echo_delay;
   /** Echo pregap ticks. */
   uint8_t echo_pregap;
   /** Stream pregap blocks. */
   uint8_t pregap;
+  /** Loop until the output fails? */
+  bool endless;
+  /** Batch mode present? */
+  bool has_batch;
   /** Channels present? */
   bool has_channels;
   /** Echo levels present? */
@@ -89,6 +130,8 @@ struct GamOptions {
   bool has_echo_pans;
   /** Echo levels present? */
   bool has_echo_pregap;
+  /** End present? */
+  bool has_end;
   /** Length present? */
   bool has_length;
   /** Loop present? */
@@ -97,12 +140,34 @@ struct GamOptions {
   bool has_mark;
   /** Pregap present? */
   bool has_pregap;
+  /** Start present? */
+  bool has_start;
+  /** Thread count present? */
+  bool has_threads;
   /** Print header? */
   bool info;
+  /** Transcode in a pipeline? */
+  bool pipeline;
+  /** Copy loops within the output? */
+  bool reflink;
   /** Include trailing samples? */
   bool trail;
+  /** Transfer through io_uring? */
+  bool uring;
 };
 
+/**
+ * Runs the given operation functions for each batch source of the given
+ * instance, or each file in it if a directory, in a pool of threads. Each task
+ * takes a copy of the options whose output is expanded from the batch template
+ * if any.
+ * Sources are taken biggest first, and tasks are bounded in open files and loop
+ * cache memory. Failures are reported by source and do not stop the batch.
+ */
+int gam_batch(struct GamInstance *instance, int (*read)(struct GamInstance *),
+              int (*act)(struct GamInstance *),
+              int (*done)(struct GamInstance *));
+
 /** Checks the output and source files of the given instance. */
 bool gam_check_files(struct GamInstance *instance, int *success);
 
@@ -140,6 +205,9 @@ struct GamOptions *gam_options_make(void);
 int gam_parse(struct ApplicationParseContext *context, struct GamOption **cases,
               size_t count, struct GamOptions *options, int (*help)(void));
 
+int gam_parse_batch(struct ApplicationParseContext *context,
+                    struct GamOptions *options);
+
 int gam_parse_channels(struct ApplicationParseContext *context,
                        struct GamOptions *options);
 
@@ -155,9 +223,15 @@ int gam_parse_echo_pans(struct ApplicationParseContext *context,
 int gam_parse_echo_pregap(struct ApplicationParseContext *context,
                           struct GamOptions *options);
 
+int gam_parse_endless(struct ApplicationParseContext *context,
+                      struct GamOptions *options);
+
 int gam_parse_info(struct ApplicationParseContext *context,
                    struct GamOptions *options);
 
+int gam_parse_io(struct ApplicationParseContext *context,
+                 struct GamOptions *options);
+
 int gam_parse_length(struct ApplicationParseContext *context,
                      struct GamOptions *options);
 
@@ -166,7 +240,8 @@ int gam_parse_mark(struct ApplicationParseContext *context,
 
 /**
  * Parses an option from the given context against the given cases to the given
- * location and return its success.
+ * location and return its success. Long options also take their argument after
+ * `=`.
  */
 bool gam_parse_option(struct ApplicationParseContext *context,
                       struct GamOption **cases, size_t count,
@@ -175,9 +250,18 @@ bool gam_parse_option(struct ApplicationParseContext *context,
 int gam_parse_output(struct ApplicationParseContext *context,
                      struct GamOptions *options);
 
+int gam_parse_pipeline(struct ApplicationParseContext *context,
+                       struct GamOptions *options);
+
 int gam_parse_pregap(struct ApplicationParseContext *context,
                      struct GamOptions *options);
 
+int gam_parse_reflink(struct ApplicationParseContext *context,
+                      struct GamOptions *options);
+
+int gam_parse_threads(struct ApplicationParseContext *context,
+                      struct GamOptions *options);
+
 int gam_parse_trail(struct ApplicationParseContext *context,
                     struct GamOptions *options);
 
@@ -190,4 +274,20 @@ int gam_run(struct GamInstance *instance, struct GamOption **options,
             int (*act)(struct GamInstance *),
             int (*done)(struct GamInstance *));
 
+#ifdef __linux__
+/**
+ * Adapts the output of the given instance, or its source, to an io_uring stream
+ * per its options, then to the given I/O stream, and returns the latter. The
+ * output is flushed first. Returns NULL if either is unavailable.
+ */
+const struct GaPcmIo *gam_uring(struct GamInstance *instance,
+                                struct GaPcmIo *io, bool output);
+
+/**
+ * Flushes the io_uring output of the given instance if any and returns its
+ * success.
+ */
+bool gam_uring_flush(struct GamInstance *instance, int *success);
+#endif
+
 #endif
@@ -5,15 +5,26 @@
  * which the application initializes into an instance.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "apphelp.h"
 #include "appinfo.h"
 #include "common/application.h"
 #include "common/constants.h"
 #include "gam.h"
+#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /** Application name. */
 #define GAMDEC_APPINFO_NAME APPINFO_NAME "dec"
 
@@ -27,6 +38,10 @@ Where:\n\
   -o, --output <path>     Path to output headerless, " APPHELP_SIGNEDNESS      \
       SPACE APPHELP_BIT_COUNT "-bit PCM file.\n\
                           `-` for pipe.\n\
+  -b, --batch <template>  Decode each given file, and each `.pcm` file in\n\
+                          each given directory, to the path from the given\n\
+                          template. `%d`: directory, `%f`: file name, `%n`:\n\
+                          file name without extension, `%%`: `%`.\n\
 Header Overrides:\n\
   -c, --channels {1|2}    1: mono, 2: stereo.\n\
   -m, --mark <blocks>     Loop start position.\n\
@@ -35,16 +50,37 @@ Header Overrides:\n\
   -p, --pregap <blocks>   Artificial silence length.\n\
 \n\
 Options:\n\
+  -E, --end <time>        Stop before the given time of the output. See\n\
+                          `--start`.\n\
+  -e, --endless           Loop until the output closes, in constant memory.\n\
+                          Overrides `--loop` and `--trail`.\n\
+  -I, --io {stdio|uring}  I/O backend. `uring` for io_uring on Linux, where\n\
+                          regular files allow. Default is `stdio`.\n\
   -i, --info              Prints the header in a friendly format.\n\
+  -j, --threads <count>   Decode in the given count of threads into a regular\n\
+                          file from a regular file. `0` for one per\n\
+                          processor. Default is `1`. In batch mode, files\n\
+                          are decoded at once in threads instead, by default\n\
+                          one per processor.\n\
   -l, --loop <count>      Write the given count of loops. `0` to stop at the\n\
                           mark; no loop. `-1` for 65535. Default is `2`.\n\
+  -P, --pipeline          Read, decode, and write in separate threads.\n\
+  -r, --reflink           Copy loops within a regular file output instead of\n\
+                          decoding them again. Copies share storage where the\n\
+                          file system allows.\n\
+  -s, --start <time>      Start from the given time of the output, counting\n\
+                          from the pregap. In frames, in seconds at 16276 Hz\n\
+                          with an `s` suffix, or as `m:ss`. Only the sectors\n\
+                          within the range are read.\n\
   -t, --trail             Include samples after the loop end.\n\
 \n\
 Echo, fade, and gain features are not supported; get their parameters with the\n\
 prober and apply them elsewhere. Also look there for details on units.\n" APPHELP_EXPLANATION
 
 /** Usage syntax. */
-#define GAMDEC_APPHELP_USAGE "Usage: -o <path> [<override>|<option>]... <file>"
+#define GAMDEC_APPHELP_USAGE                                                   \
+  "Usage: -o <path> [<override>|<option>]... <file>" EOL                       \
+  "       -b <template> [<override>|<option>]... <file>|<directory>..."
 
 int gamdec_parse_loop(struct ApplicationParseContext *c,
                       struct GamOptions *options) {
@@ -58,6 +94,60 @@ int gamdec_parse_loop(struct ApplicationParseContext *c,
   return out;
 }
 
+/**
+ * Parses a time as a frame to the given location and marks it present. Times
+ * are in frames, in seconds with an `s` suffix, or in minutes and seconds as
+ * `m:ss`, at `GAM_RATE`.
+ */
+int gamdec_parse_time(struct ApplicationParseContext *c,
+                      unsigned long long *frame, bool *present) {
+  if (c->index >= c->COUNT) {
+    return application_error_argument_nul(c->option);
+  }
+  const char *argument = c->arguments[c->index];
+  const char *colon = strchr(argument, ':');
+  if (colon == NULL &&
+      (*argument == '\0' || argument[strlen(argument) - 1] != 's')) {
+    long long number;
+    int out = application_parse_integer(c, &number, 0, LLONG_MAX, "64-bit");
+    if (out == EXIT_SUCCESS) {
+      *frame = number;
+      *present = true;
+    }
+    return out;
+  }
+  c->argument = c->arguments[c->index++];
+  char *end = NULL;
+  double seconds = -1;
+  if (isdigit((unsigned char)*argument)) {
+    seconds = strtod(argument, &end);
+  }
+  if (colon != NULL && end == colon && isdigit((unsigned char)colon[1])) {
+    seconds = 60 * seconds + strtod(&colon[1], &end);
+  } else if (colon != NULL) {
+    end = NULL;
+  } else if (end != NULL && *end == 's') {
+    end++;
+  }
+  if (end == NULL || *end != '\0' || !(seconds * GAM_RATE < 1e18)) {
+    return application_error_argument_bad(
+        c->option, c->argument, "Not frames, seconds with `s`, or `m:ss`.");
+  }
+  *frame = (unsigned long long)(seconds * GAM_RATE + 0.5);
+  *present = true;
+  return EXIT_SUCCESS;
+}
+
+int gamdec_parse_end(struct ApplicationParseContext *c,
+                     struct GamOptions *options) {
+  return gamdec_parse_time(c, &options->end, &options->has_end);
+}
+
+int gamdec_parse_start(struct ApplicationParseContext *c,
+                       struct GamOptions *options) {
+  return gamdec_parse_time(c, &options->start, &options->has_start);
+}
+
 bool gamdec_act_check(struct GamInstance *i, int *success,
                       const unsigned long long count,
                       const unsigned long long comparand) {
@@ -70,18 +160,285 @@ bool gamdec_act_check(struct GamInstance *i, int *success,
   return *success == EXIT_SUCCESS;
 }
 
+/**
+ * Adapts the output of the given instance to the given I/O stream and returns
+ * the latter. On Linux, regular files are written through io_uring if opted
+ * in, and standard output to a pipe is flushed and then spliced into. Others
+ * are written through the file.
+ */
+const struct GaPcmIo *gamdec_output(struct GamInstance *i, struct GaPcmIo *io) {
+#ifdef __linux__
+  const struct GaPcmIo *out = gam_uring(i, io, true);
+  if (out != NULL) {
+    return out;
+  }
+  if (i->output == stdout && fflush(i->output) == SUCCESS) {
+    i->pipe = gapcm_io_pipe_make(fileno(i->output));
+    if (i->pipe != NULL) {
+      return gapcm_io_pipe(io, i->pipe);
+    }
+  }
+#endif
+  return gapcm_io_file(io, i->output);
+}
+
+/**
+ * Adapts the source of the given instance to the given I/O stream and returns
+ * the latter. On Linux, regular files are read through io_uring if opted in.
+ * Otherwise, regular files are mapped and decoded in place from the current
+ * position, so loops seek without system calls. Others, such as pipes, are read
+ * through the file.
+ */
+const struct GaPcmIo *gamdec_source(struct GamInstance *i, struct GaPcmIo *io) {
+#ifdef __linux__
+  const struct GaPcmIo *out = gam_uring(i, io, false);
+  if (out != NULL) {
+    return out;
+  }
+#endif
+#ifndef _WIN32
+  if (gapcm_io_memory_map(i->map, fileno(i->source))) {
+    long long position = ftello(i->source);
+    if (position >= 0 && (unsigned long long)position <= i->map->count) {
+      i->map->position = position;
+      return gapcm_io_memory(io, i->map);
+    }
+    gapcm_io_memory_unmap(i->map);
+  }
+#endif
+  return gapcm_io_file(io, i->source);
+}
+
+/**
+ * Decodes the source of the given instance to its output in parallel if its
+ * options allow and returns whether it did. The source must be mapped and the
+ * output a regular file, so that each part of the render plan lands at its
+ * offset. The output is preallocated to the planned size.
+ */
+bool gamdec_act_parallel(struct GamInstance *i, int *success) {
+#ifdef _WIN32
+  // Wunused-parameter
+  return i == NULL && success == NULL;
+#else
+  struct stat status;
+  if (i->options->threads == 1 || i->options->endless ||
+      i->map->bytes == NULL ||
+      i->write_count != GAPCM_BLOCK_BYTES * i->header->pregap ||
+      fflush(i->output) != SUCCESS ||
+      fstat(fileno(i->output), &status) != SUCCESS ||
+      !S_ISREG(status.st_mode)) {
+    return false;
+  }
+  long long offset = ftello(i->output);
+  if (offset < 0) {
+    return false;
+  }
+  struct GaPcmPlan plan;
+  gapcm_decode_plan(i->header, i->map->count, i->options->loop,
+                    i->options->trail, &plan);
+  unsigned long long count_plan = plan.count;
+  size_t count = 0;
+  struct GaPcmSegment *segments =
+      malloc(sizeof(*segments) * (GAPCM_PLAN_PARTS + i->options->loop));
+  for (size_t index = 0; index < plan.part_count; index++) {
+    struct GaPcmPart *part = &plan.parts[index];
+    if (part->kind == GAPCM_PART_SILENCE) {
+      // Written already.
+      count_plan -= part->segment.count;
+    } else if (part->kind == GAPCM_PART_SOURCE) {
+      segments[count++] = part->segment;
+    } else {
+      // Repeats the loop before, which sizes each repeat.
+      for (unsigned long long repeat = 0;
+           repeat < part->segment.count / segments[count - 1].count;
+           repeat++) {
+        segments[count] = segments[count - 1];
+        count++;
+      }
+    }
+  }
+  posix_fallocate(fileno(i->output), offset, count_plan);
+  errno = 0;
+  unsigned long long count_write = gapcm_session_decode_parallel(
+      i->session, i->map, segments, count, fileno(i->output), offset,
+      i->options->threads);
+  free(segments);
+  i->write_count += count_write;
+  if (count_write != count_plan ||
+      (!plan.whole && (!i->options->trail || i->options->loop > 1))) {
+    *success = EXIT_FAILURE;
+    application_print_message(i->options->output, GAM_ERROR_OUTPUT);
+  }
+  if (errno != 0) {
+    *success = EXIT_FAILURE;
+    application_print_message(i->options->output, strerror(errno));
+  }
+  // Drops what was preallocated but not written.
+  if (count_write != count_plan &&
+      ftruncate(fileno(i->output), offset + count_write) != SUCCESS) {
+    *success = EXIT_FAILURE;
+  }
+  fseeko(i->output, offset + count_write, SEEK_SET);
+  return true;
+#endif
+}
+
+/**
+ * Returns whether loops can be copied within the output of the given instance.
+ * Its options must allow, and the output must be a readable regular file
+ * written through the output stream.
+ */
+bool gamdec_act_reflinks(struct GamInstance *i) {
+#ifdef _WIN32
+  // Wunused-parameter
+  return i == NULL;
+#else
+  struct stat status;
+  return i->options->reflink && i->pipe == NULL && i->urings[1] == NULL &&
+         fstat(fileno(i->output), &status) == SUCCESS &&
+         S_ISREG(status.st_mode) &&
+         (fcntl(fileno(i->output), F_GETFL) & O_ACCMODE) == O_RDWR;
+#endif
+}
+
+/**
+ * Repeats the given count of bytes that end the output of the given instance
+ * for the given count of times and returns the count of bytes written.
+ */
+unsigned long long gamdec_act_reflink(struct GamInstance *i,
+                                      const unsigned long long count,
+                                      const unsigned long long times) {
+#ifdef _WIN32
+  // Wunused-parameter
+  return i == NULL && count == times;
+#else
+  long long offset = fflush(i->output) == SUCCESS ? ftello(i->output) : -1;
+  if (offset < 0) {
+    return 0;
+  }
+  unsigned long long out =
+      gapcm_io_fd_repeat(fileno(i->output), offset, count, times);
+  fseeko(i->output, offset + out, SEEK_SET);
+  return out;
+#endif
+}
+
+/**
+ * Decodes the range of the output between the start and end of the options of
+ * the given instance if given, and returns whether it did. The pull decoder
+ * seeks straight to the start, so only the sectors within the range are read.
+ */
+bool gamdec_act_range(struct GamInstance *i, const struct GaPcmIo *source,
+                      struct GaPcmIo *io, int *success) {
+  struct GamOptions *o = i->options;
+  if (!o->has_start && !o->has_end) {
+    return false;
+  }
+  const struct GaPcmIo *output = gamdec_output(i, io);
+  struct GaPcmDecoder *decoder = gapcm_decoder_make_io(
+      i->session, source, o->endless ? INT_MAX : o->loop, o->trail);
+  unsigned long long count_frame =
+      GAPCM_SAMPLE_BYTES * gapcm_to_channelcount(i->header->format);
+  unsigned long long frame = o->start;
+  unsigned long long end = o->has_end ? o->end : ULLONG_MAX;
+  if (decoder != NULL && frame < end && gapcm_decoder_seek(decoder, frame)) {
+    const uint8_t *frames;
+    size_t count;
+    while (frame < end &&
+           (count = gapcm_decoder_next(
+                decoder, end - frame < UINT32_MAX ? end - frame : UINT32_MAX,
+                &frames)) > 0) {
+      size_t count_write = output->WRITE(output->user, frames, count);
+      i->write_count += count_write;
+      frame += count_write / count_frame;
+      if (count_write != count) {
+        break;
+      }
+    }
+  }
+  decoder = gapcm_decoder_free(decoder);
+  if (o->has_end ? frame != end : o->has_start && frame == o->start) {
+    *success = EXIT_FAILURE;
+    application_print_message(o->output, GAM_ERROR_OUTPUT);
+  }
+  if (feof(i->source) && !ferror(i->source)) {
+    clearerr(i->source);
+  }
+  return true;
+}
+
+/**
+ * Drops what is left to write to the closed output of the given instance, so
+ * that closing it does not fail again.
+ */
+void gamdec_act_closed(struct GamInstance *i) {
+#ifndef _WIN32
+  int fd = open("/dev/null", O_WRONLY);
+  if (fd >= 0) {
+    dup2(fd, fileno(i->output));
+    close(fd);
+  }
+#endif
+  clearerr(i->output);
+}
+
 int gamdec_act(struct GamInstance *i) {
   int out = EXIT_SUCCESS;
-  i->write_count += gapcm_decode_pregap(i->header->pregap, i->output);
-  while (i->write_count == GAPCM_BLOCK_BYTES * i->header->pregap) {
+  bool closed = false;
+  struct GaPcmIo ios[2];
+  const struct GaPcmIo *source = gamdec_source(i, &ios[0]);
+  i->session = gapcm_session_make(i->header);
+  gapcm_session_pipeline(i->session, i->options->pipeline);
+  gapcm_session_cache(i->session, i->options->cache > 0
+                                      ? i->options->cache
+                                      : GAPCM_LOOP_CACHE_BYTES);
+  bool range = gamdec_act_range(i, source, &ios[1], &out);
+  if (!range) {
+    i->write_count += gapcm_decode_pregap(i->header->pregap, i->output);
+  }
+  const struct GaPcmIo *output = range || gamdec_act_parallel(i, &out)
+                                     ? NULL
+                                     : gamdec_output(i, &ios[1]);
+  while (output != NULL &&
+         i->write_count == GAPCM_BLOCK_BYTES * i->header->pregap) {
     unsigned long long mark = GAPCM_BLOCK_BYTES * i->header->mark;
     unsigned long long length = GAPCM_SAMPLE_BYTES * i->header->length *
                                 gapcm_to_channelcount(i->header->format);
     unsigned long long length_loop = length - mark;
+    if (i->options->endless) {
+#ifndef _WIN32
+      // The output closing ends the loops, so it fails writes instead.
+      signal(SIGPIPE, SIG_IGN);
+#endif
+      errno = 0;
+      i->write_count += gapcm_session_decode_io(i->session, source, output,
+                                                GAPCM_LOOP_FOREVER);
+      closed = errno == EPIPE;
+      if (closed) {
+        gamdec_act_closed(i);
+      } else {
+        out = EXIT_FAILURE;
+        application_print_message(i->options->output, GAM_ERROR_OUTPUT);
+        if (errno != 0) {
+          application_print_message(i->options->output, strerror(errno));
+        }
+      }
+      break;
+    }
     if (i->options->loop > 1) {
+      // Loops after the first match one another, so the rest may be copies of
+      // the second.
+      uint16_t loop = i->options->loop > 3 && gamdec_act_reflinks(i)
+                          ? 2
+                          : i->options->loop - 1;
       errno = 0;
-      unsigned long long count = gapcm_decode_stream(
-          i->header, i->source, i->output, i->options->loop - 1);
+      unsigned long long count =
+          gapcm_session_decode_io(i->session, source, output, loop);
+      if (loop < i->options->loop - 1 &&
+          count == length + length_loop * (loop - 1)) {
+        count += gamdec_act_reflink(i, length_loop,
+                                    i->options->loop - 1 - loop);
+      }
       if (!gamdec_act_check(i, &out, count,
                             length + length_loop * (i->options->loop - 2))) {
         if (errno != 0) {
@@ -93,33 +450,43 @@ int gamdec_act(struct GamInstance *i) {
         break;
       }
       errno = 0;
-      if (gapcm_decode_seek(i->source, i->header->mark) != SUCCESS) {
+      if (source->SEEK(source->user,
+                       GAPCM_SECTOR_BYTES * (1ULL + i->header->mark)) !=
+          SUCCESS) {
         out = EXIT_FAILURE;
         application_print_message(i->options->source, strerror(errno));
         break;
       }
     }
     if (i->options->trail) {
-      i->write_count +=
-          gapcm_decode_stream_for(i->header, i->source, i->output, UINT32_MAX);
+      i->write_count += gapcm_session_decode_io_for(i->session, source,
+                                                    output, UINT32_MAX);
       if (feof(i->source) && !ferror(i->source)) {
         clearerr(i->source);
       }
     } else {
       unsigned long long count;
       if (i->options->loop > 1) {
-        count = gapcm_decode_loop(i->header, i->source, i->output, 1);
+        count = gapcm_session_decode_io_loop(i->session, source, output, 1);
         gamdec_act_check(i, &out, count, length_loop);
       } else {
-        count = gapcm_decode_stream(i->header, i->source, i->output,
-                                    i->options->loop);
+        count = gapcm_session_decode_io(i->session, source, output,
+                                        i->options->loop);
         gamdec_act_check(i, &out, count, mark + length_loop * i->options->loop);
       }
       i->write_count += count;
     }
     break;
   }
-  if (out == EXIT_SUCCESS) {
+#ifdef __linux__
+  if (!closed && i->pipe != NULL && !gapcm_io_pipe_flush(i->pipe) &&
+      out == EXIT_SUCCESS) {
+    out = EXIT_FAILURE;
+    application_print_message(i->options->output, GAM_ERROR_WRITE);
+  }
+  gam_uring_flush(i, &out);
+#endif
+  if (out == EXIT_SUCCESS && !closed) {
     gam_check_files(i, &out);
   }
   return out;
@@ -209,17 +576,24 @@ int gamdec_read(struct GamInstance *i) {
       application_print_message(o->source, error);
       break;
     }
+    if (o->has_start && o->has_end && o->end < o->start) {
+      out = EXIT_FAILURE;
+      application_print_message(GAMDEC_APPINFO_NAME, "End is before start.");
+      break;
+    }
     if (!o->has_channels && gapcm_to_channelcount(h->format) == 2) {
       application_print_message(GAMDEC_APPINFO_NAME, GAM_ALERT_STEREO);
     }
-    gam_open_output(o->output, &i->output, &out);
+    // Loops are copied from the output, so it is read too.
+    out = application_file_open(o->output, o->reflink ? "w+b" : "wb",
+                                &i->output, " output", stdout);
     break;
   }
   free(sector);
   return out;
 }
 
-#define GAMDEC_OPTION_COUNT 8
+#define GAMDEC_OPTION_COUNT 16
 /** The main method is the entry point to this application. */
 int main(int argument_count, char *arguments[]) {
   if (argument_count < 2) {
@@ -229,15 +603,25 @@ int main(int argument_count, char *arguments[]) {
     return EXIT_SUCCESS;
   }
   struct GamInstance *instance = gam_instance_make(arguments, argument_count);
+  instance->name = GAMDEC_APPINFO_NAME;
+  instance->extension = ".pcm";
   struct GamOption **options = malloc(sizeof(options) * GAMDEC_OPTION_COUNT);
-  options[0] = gam_option_make("-c", "--channels", gam_parse_channels);
-  options[1] = gam_option_make("-i", "--info", gam_parse_info);
-  options[2] = gam_option_make("-l", "--loop", gamdec_parse_loop);
-  options[3] = gam_option_make("-m", "--mark", gam_parse_mark);
-  options[4] = gam_option_make("-n", "--length", gam_parse_length);
-  options[5] = gam_option_make("-o", "--output", gam_parse_output);
-  options[6] = gam_option_make("-p", "--pregap", gam_parse_pregap);
-  options[7] = gam_option_make("-t", "--trail", gam_parse_trail);
+  options[0] = gam_option_make("-b", "--batch", gam_parse_batch);
+  options[1] = gam_option_make("-c", "--channels", gam_parse_channels);
+  options[2] = gam_option_make("-E", "--end", gamdec_parse_end);
+  options[3] = gam_option_make("-e", "--endless", gam_parse_endless);
+  options[4] = gam_option_make("-I", "--io", gam_parse_io);
+  options[5] = gam_option_make("-i", "--info", gam_parse_info);
+  options[6] = gam_option_make("-j", "--threads", gam_parse_threads);
+  options[7] = gam_option_make("-l", "--loop", gamdec_parse_loop);
+  options[8] = gam_option_make("-m", "--mark", gam_parse_mark);
+  options[9] = gam_option_make("-n", "--length", gam_parse_length);
+  options[10] = gam_option_make("-o", "--output", gam_parse_output);
+  options[11] = gam_option_make("-P", "--pipeline", gam_parse_pipeline);
+  options[12] = gam_option_make("-p", "--pregap", gam_parse_pregap);
+  options[13] = gam_option_make("-r", "--reflink", gam_parse_reflink);
+  options[14] = gam_option_make("-s", "--start", gamdec_parse_start);
+  options[15] = gam_option_make("-t", "--trail", gam_parse_trail);
   int out = gam_run(instance, options, GAMDEC_OPTION_COUNT, gamdec_help,
                     gamdec_read, gamdec_act, gamdec_done);
   instance = gam_instance_free(instance);
@@ -5,6 +5,8 @@
  * which the application initializes into an instance.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "apphelp.h"
 #include "appinfo.h"
 #include "common/application.h"
@@ -14,13 +16,23 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
 /** Usage syntax. */
-#define GAMENC_APPHELP_USAGE "Usage: -o <path> [<field>|<option>]... <file>"
+#define GAMENC_APPHELP_USAGE                                                   \
+  "Usage: -o <path> [<field>|<option>]... <file>" EOL                          \
+  "       -b <template> [<field>|<option>]... <file>|<directory>..."
 /** Explanation to syntax. */
 #define GAMENC_APPHELP_EXPLANATION                                             \
   "\
 Where:\n\
   -o,  --output <path>      Path to output game PCM file. `-` for pipe.\n\
+  -b,  --batch <template>   Encode each given file, and each file in each\n\
+                            given directory, to the path from the given\n\
+                            template. `%d`: directory, `%f`: file name, `%n`:\n\
+                            file name without extension, `%%`: `%`.\n\
 \n\
 Header Fields:\n\
   -c,  --channels {1|2}     1: mono (default), 2: stereo.\n\
@@ -39,6 +51,14 @@ Header Fields:\n\
   -p,  --pregap <blocks>    Artificial silence length. Default is `0`.\n\
 \n\
 Options:\n\
+  -I, --io {stdio|uring}    I/O backend. `uring` for io_uring on Linux, where\n\
+                            regular files allow. Default is `stdio`.\n\
+  -j, --threads <count>     Encode in the given count of threads into a\n\
+                            regular file from a regular file. `0` for one per\n\
+                            processor. Default is `1`. In batch mode, files\n\
+                            are encoded at once in threads instead, by\n\
+                            default one per processor.\n\
+  -P, --pipeline            Read, encode, and write in separate threads.\n\
   -t, --trail               Include samples after the loop end.\n\
 \n\
 The input file must be headerless, " APPHELP_SIGNEDNESS SPACE                  \
@@ -55,8 +75,77 @@ int gamenc_error_header(void) {
   return EXIT_FAILURE;
 }
 
+/**
+ * Adapts the output of the given instance, or its source, to the given I/O
+ * stream and returns the latter. On Linux, regular files are transferred
+ * through io_uring if opted in. Others are transferred through the file.
+ */
+const struct GaPcmIo *gamenc_io(struct GamInstance *i, struct GaPcmIo *io,
+                                const bool output) {
+#ifdef __linux__
+  const struct GaPcmIo *out = gam_uring(i, io, output);
+  if (out != NULL) {
+    return out;
+  }
+#endif
+  return gapcm_io_file(io, output ? i->output : i->source);
+}
+
+/**
+ * Encodes the source of the given instance to its output in parallel if its
+ * options allow and returns whether it did. The source must be mapped and the
+ * output a regular file, so that each block lands at its computed offset. The
+ * source is left as a serial encode would leave it.
+ */
+bool gamenc_act_parallel(struct GamInstance *i, int *success) {
+#ifdef _WIN32
+  // Wunused-parameter
+  return i == NULL && success == NULL;
+#else
+  struct stat status;
+  if (i->options->threads == 1 ||
+      !gapcm_io_memory_map(i->map, fileno(i->source))) {
+    return false;
+  }
+  long long offsets[] = {ftello(i->source), -1};
+  if (fflush(i->output) == SUCCESS &&
+      fstat(fileno(i->output), &status) == SUCCESS &&
+      S_ISREG(status.st_mode)) {
+    offsets[1] = ftello(i->output);
+  }
+  if (offsets[0] < 0 || (unsigned long long)offsets[0] > i->map->count ||
+      offsets[1] < 0) {
+    gapcm_io_memory_unmap(i->map);
+    return false;
+  }
+  uint32_t count = i->options->trail ? UINT32_MAX : i->header->length;
+  i->map->position = offsets[0];
+  errno = 0;
+  unsigned long long count_write = gapcm_session_encode_parallel(
+      i->session, i->map, fileno(i->output), offsets[1], count,
+      i->options->threads);
+  i->write_count += count_write;
+  if (errno != 0) {
+    *success = EXIT_FAILURE;
+    application_print_message(i->options->output, strerror(errno));
+  }
+  fseeko(i->output, offsets[1] + count_write, SEEK_SET);
+  if (i->map->count - offsets[0] <
+      (unsigned long long)count * gapcm_to_channelcount(i->header->format)) {
+    fseeko(i->source, 0, SEEK_END);
+    getc(i->source);
+  } else {
+    fseeko(i->source, offsets[0] + (unsigned long long)count *
+                                       gapcm_to_channelcount(i->header->format),
+           SEEK_SET);
+  }
+  return true;
+#endif
+}
+
 int gamenc_act(struct GamInstance *i) {
   int out = EXIT_SUCCESS;
+  struct GaPcmIo ios[2];
   uint8_t *sector = malloc(GAPCM_SECTOR_BYTES);
   while (true) {
     uint16_t channel_count = gapcm_to_channelcount(i->header->format);
@@ -71,11 +160,26 @@ int gamenc_act(struct GamInstance *i) {
         GAPCM_SECTOR_BYTES) {
       break;
     }
-    i->write_count +=
-        i->options->trail
-            ? gapcm_encode_stream_for(i->header, i->source, i->output,
-                                      UINT32_MAX)
-            : gapcm_encode_stream(i->header, i->source, i->output);
+    i->session = gapcm_session_make(i->header);
+    gapcm_session_pipeline(i->session, i->options->pipeline);
+    if (gamenc_act_parallel(i, &out)) {
+      if (out != EXIT_SUCCESS) {
+        break;
+      }
+    } else {
+      const struct GaPcmIo *source = gamenc_io(i, &ios[0], false);
+      const struct GaPcmIo *output = gamenc_io(i, &ios[1], true);
+      i->write_count +=
+          i->options->trail
+              ? gapcm_session_encode_io_for(i->session, source, output,
+                                            UINT32_MAX)
+              : gapcm_session_encode_io(i->session, source, output);
+#ifdef __linux__
+      if (!gam_uring_flush(i, &out)) {
+        break;
+      }
+#endif
+    }
     if (i->options->has_length) {
       unsigned long long comparand =
           i->header->length * channel_count * GAPCM_SECTOR_BLOCKS;
@@ -193,7 +297,7 @@ int gamenc_read(struct GamInstance *i) {
   return out;
 }
 
-#define GAMENC_OPTION_COUNT 10
+#define GAMENC_OPTION_COUNT 14
 /** The main method is the entry point to this application. */
 int main(int argument_count, char *arguments[]) {
   if (argument_count < 2) {
@@ -203,17 +307,22 @@ int main(int argument_count, char *arguments[]) {
     return EXIT_SUCCESS;
   }
   struct GamInstance *instance = gam_instance_make(arguments, argument_count);
+  instance->name = GAMENC_APPINFO_NAME;
   struct GamOption **options = malloc(sizeof(options) * GAMENC_OPTION_COUNT);
-  options[0] = gam_option_make("-c", "--channels", gam_parse_channels);
-  options[1] = gam_option_make("-ea", "--echo-pans", gam_parse_echo_pans);
-  options[2] = gam_option_make("-ed", "--echo-delay", gam_parse_echo_delay);
-  options[3] = gam_option_make("-el", "--echo-levels", gam_parse_echo_levels);
-  options[4] = gam_option_make("-ep", "--echo-pregap", gam_parse_echo_pregap);
-  options[5] = gam_option_make("-m", "--mark", gam_parse_mark);
-  options[6] = gam_option_make("-n", "--length", gam_parse_length);
-  options[7] = gam_option_make("-o", "--output", gam_parse_output);
-  options[8] = gam_option_make("-p", "--pregap", gam_parse_pregap);
-  options[9] = gam_option_make("-t", "--trail", gam_parse_trail);
+  options[0] = gam_option_make("-b", "--batch", gam_parse_batch);
+  options[1] = gam_option_make("-c", "--channels", gam_parse_channels);
+  options[2] = gam_option_make("-ea", "--echo-pans", gam_parse_echo_pans);
+  options[3] = gam_option_make("-ed", "--echo-delay", gam_parse_echo_delay);
+  options[4] = gam_option_make("-el", "--echo-levels", gam_parse_echo_levels);
+  options[5] = gam_option_make("-ep", "--echo-pregap", gam_parse_echo_pregap);
+  options[6] = gam_option_make("-I", "--io", gam_parse_io);
+  options[7] = gam_option_make("-j", "--threads", gam_parse_threads);
+  options[8] = gam_option_make("-m", "--mark", gam_parse_mark);
+  options[9] = gam_option_make("-n", "--length", gam_parse_length);
+  options[10] = gam_option_make("-o", "--output", gam_parse_output);
+  options[11] = gam_option_make("-P", "--pipeline", gam_parse_pipeline);
+  options[12] = gam_option_make("-p", "--pregap", gam_parse_pregap);
+  options[13] = gam_option_make("-t", "--trail", gam_parse_trail);
   int out = gam_run(instance, options, GAMENC_OPTION_COUNT, gamenc_help,
                     gamenc_read, gamenc_act, gamenc_done);
   instance = gam_instance_free(instance);
@@ -5,18 +5,32 @@
  * which the application initializes into an instance.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "apphelp.h"
 #include "appinfo.h"
 #include "common/application.h"
 #include "common/constants.h"
 #include "common/strings.h"
 #include "gam.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 /** Usage syntax. */
-#define GAMINFO_APPHELP_USAGE "Usage: ([<field>] <file>) | -bf"
+#define GAMINFO_APPHELP_USAGE                                                  \
+  "Usage: ([<field>] <file>) | -bf" EOL                                        \
+  "       -f {csv|json} [-j <count>] <file>|<directory>..." EOL              \
+  "       -C <catalog> [-q <terms>] [-f {csv|json}] [-j <count>]" EOL        \
+  "         [<file>|<directory>]..."
 /** Explanation to syntax. */
 #define GAMINFO_APPHELP_EXPLANATION                                            \
   "\
@@ -33,6 +47,39 @@ Header Fields:\n\
 \n\
 If none is given, then it prints the header in a friendly format.\n\
 \n\
+Records:\n\
+  -f,  --format {csv|json}\n\
+                      Prints a record for each given file, and each `.pcm`\n\
+                      file in each given directory, instead. `csv`: values\n\
+                      under a heading line, `json`: an object per line. Only\n\
+                      the header sector is read. Records are in completion\n\
+                      order.\n\
+  -j,  --threads <count>\n\
+                      Probe the given count of files at once for records.\n\
+                      `0` for one per processor. Default is `0`.\n\
+\n\
+Catalog:\n\
+  -C,  --catalog <file>\n\
+                      Catalogs each given file, and each `.pcm` file in each\n\
+                      given directory, to the given file: its path, size,\n\
+                      modification time, header, and content hash. Files\n\
+                      unchanged in size and modification time since are not\n\
+                      read again, files not given are dropped. Without files,\n\
+                      the catalog is only read.\n\
+  -q,  --query <term>[,<term>]...\n\
+                      After `-C`, prints the record of each cataloged file\n\
+                      matching every term of `<field><operator><number>`, in\n\
+                      `-f` format or `json`. Fields are the numeric ones of\n\
+                      records, `valid` and `size_ok` take `true` or `false`.\n\
+                      Operators are `=`, `!=`, `<`, `<=`, `>`, and `>=`. For\n\
+                      example, `channels=2,loop_duration>60` for stereo with\n\
+                      loops longer than a minute.\n\
+\n\
+Records hold the header fields, the channel count, the duration to the loop\n\
+end and the loop length in frames and seconds at 16276 Hz, the expected file\n\
+size for the length and whether the file has it in whole sectors, the\n\
+validation result, and the content hash if cataloged.\n\
+\n\
 Build Information:\n\
   -bf, --build-flags  1: 16-bit extension enabled, 0: otherwise.\n\
 \n\
@@ -43,6 +90,678 @@ A block spans 1024 samples, a frame spans one sample for mono, two for stereo.\n
 /** Application description. */
 #define GAMINFO_APPINFO_DESCRIPTION APPINFO_DESCRIPTION "header prober."
 
+/** Record format: comma-separated values. */
+#define GAMINFO_FORMAT_CSV "csv"
+/** Record format: JSON lines. */
+#define GAMINFO_FORMAT_JSON "json"
+/** Heading line of comma-separated records. */
+#define GAMINFO_RECORD_HEADING                                                 \
+  "path,size,valid,error,format,mark,length,pregap,echo_delay,echo_pregap,"    \
+  "echo_levels,echo_pans,channels,duration,loop_length,loop_duration,"         \
+  "expected_size,size_ok,hash"
+/** Capacity of a record without its path and error in bytes. */
+#define GAMINFO_RECORD_CAPACITY 512
+/** Catalog file signature. */
+#define GAMINFO_CATALOG_MAGIC "GAPCMCAT"
+/** Catalog file version. */
+#define GAMINFO_CATALOG_VERSION 1
+/** Size of a catalog entry without its path in bytes. */
+#define GAMINFO_CATALOG_ENTRY_BYTES 53
+/** Buffer capacity for hashing in bytes. */
+#define GAMINFO_HASH_CAPACITY (1 << 20)
+
+/** Represents a catalog entry. */
+struct GamInfoEntry {
+  /** GAPCM header. Valid if parsed. */
+  struct GaPcmHeader header;
+  /** File name. */
+  char *path;
+  /** FNV-1a hash of the file content. */
+  uint64_t hash;
+  /** File size in bytes. */
+  unsigned long long size;
+  /** Modification time in seconds. */
+  long long mtime;
+  /** Modification time nanoseconds. */
+  uint32_t mtime_nanoseconds;
+  /** Header parsed? */
+  bool parsed;
+};
+
+/** Represents a catalog of entries sorted by path. */
+struct GamInfoCatalog {
+  /** Entries. */
+  struct GamInfoEntry *entries;
+  /** Entry capacity. */
+  size_t capacity;
+  /** Entry count. */
+  size_t count;
+};
+
+/** Queryable record fields. */
+enum GamInfoField {
+  SIZE,
+  VALID,
+  FORMAT,
+  MARK,
+  LENGTH,
+  PREGAP,
+  ECHO_DELAY,
+  ECHO_PREGAP,
+  CHANNELS,
+  DURATION,
+  LOOP_LENGTH,
+  LOOP_DURATION,
+  EXPECTED_SIZE,
+  SIZE_OK,
+  FIELD_COUNT
+};
+
+/** Names of queryable record fields. */
+static const char *GAMINFO_FIELDS[] = {
+    "size",          "valid",    "format",      "mark",
+    "length",        "pregap",   "echo_delay",  "echo_pregap",
+    "channels",      "duration", "loop_length", "loop_duration",
+    "expected_size", "size_ok"};
+
+/** Represents a query term. */
+struct GamInfoTerm {
+  /** Comparand. */
+  double value;
+  /** Field. */
+  enum GamInfoField field;
+  /** Matching comparisons. 1: less, 2: equal, 4: greater. */
+  int comparisons;
+};
+
+/** Loaded catalog and the one rebuilt from the given files. */
+static struct GamInfoCatalog gaminfo_catalogs[2];
+/** Catalog file name. NULL for none. */
+static char *gaminfo_catalog_name;
+/** Query terms. */
+static struct GamInfoTerm *gaminfo_terms;
+/** Count of query terms. */
+static size_t gaminfo_term_count;
+/** Count of files read again. */
+static size_t gaminfo_reread_count;
+/** Only querying? */
+static bool gaminfo_query_only;
+#ifndef _WIN32
+/** Guards the rebuilt catalog. */
+static pthread_mutex_t gaminfo_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/**
+ * Returns the given string quoted for the given record format. CSV values are
+ * quoted only where needed.
+ */
+static char *gaminfo_quote(const char *string, const bool json) {
+  char *out = malloc(6 * strlen(string) + 3);
+  char *o = out;
+  bool quote = json || strpbrk(string, ",\"\r\n") != NULL;
+  if (quote) {
+    *o++ = '"';
+  }
+  for (const char *c = string; *c != '\0'; c++) {
+    if (!json) {
+      if (*c == '"') {
+        *o++ = '"';
+      }
+      *o++ = *c;
+    } else if (*c == '"' || *c == '\\') {
+      *o++ = '\\';
+      *o++ = *c;
+    } else if ((unsigned char)*c < 0x20) {
+      o += sprintf(o, "\\u%04x", (unsigned char)*c);
+    } else {
+      *o++ = *c;
+    }
+  }
+  if (quote) {
+    *o++ = '"';
+  }
+  *o = '\0';
+  return out;
+}
+
+/**
+ * Derives the loop length in frames, the expected file size, and whether the
+ * given size meets it from the given header. Returns its channel count, or `0`
+ * with nothing derived if its format is invalid.
+ */
+static uint16_t gaminfo_derive(const struct GaPcmHeader *h,
+                               const long long size, long long *loop_length,
+                               unsigned long long *expected, bool *size_ok) {
+  uint16_t out = gapcm_to_channelcount(h->format);
+  if (out == 0) {
+    return out;
+  }
+  // Sectors hold a block of samples of each channel.
+  *loop_length = h->length - (long long)h->mark * (GAPCM_BLOCK_SAMPLES / out);
+  unsigned long long count = (unsigned long long)h->length * out *
+                             GAPCM_SECTOR_BYTES / GAPCM_BLOCK_SAMPLES;
+  *expected = GAPCM_SECTOR_BYTES + count - count % GAPCM_SECTOR_BYTES +
+              GAPCM_SECTOR_BYTES * (count % GAPCM_SECTOR_BYTES > 0 ? out : 0);
+  *size_ok = size >= 0 && (unsigned long long)size >= *expected &&
+             size % GAPCM_SECTOR_BYTES == 0;
+  return out;
+}
+
+/**
+ * Returns a record line in the given format for the given file name, size,
+ * header, and content hash. The size is negative if unknown, the header NULL if
+ * it can not be parsed, the error NULL if it is valid, and the hash NULL if
+ * unknown.
+ */
+static char *gaminfo_record(const char *name, const long long size,
+                            const struct GaPcmHeader *h, const char *error,
+                            const uint64_t *hash, const bool json) {
+  const char *null = json ? "null" : "";
+  char *strings[] = {gaminfo_quote(name, json),
+                     error == NULL ? NULL : gaminfo_quote(error, json)};
+  size_t capacity = strlen(strings[0]) + GAMINFO_RECORD_CAPACITY +
+                    (error == NULL ? 0 : strlen(strings[1]));
+  char *out = malloc(capacity);
+  char size_string[24];
+  snprintf(size_string, sizeof(size_string), "%lld", size);
+  size_t count = snprintf(
+      out, capacity,
+      json ? "{\"path\":%s,\"size\":%s,\"valid\":%s,\"error\":%s"
+           : "%s,%s,%s,%s",
+      strings[0], size < 0 ? null : size_string,
+      error == NULL ? "true" : "false", error == NULL ? null : strings[1]);
+  long long loop_length;
+  unsigned long long expected;
+  bool size_ok;
+  uint16_t channel_count =
+      h == NULL ? 0
+                : gaminfo_derive(h, size, &loop_length, &expected, &size_ok);
+  if (h != NULL) {
+    count += snprintf(
+        &out[count], capacity - count,
+        json ? ",\"format\":%u,\"mark\":%u,\"length\":%u,\"pregap\":%u,"
+               "\"echo_delay\":%u,\"echo_pregap\":%u,"
+               "\"echo_levels\":[%u,%u,%u],"
+               "\"echo_pans\":[%u,%u,%u,%u,%u,%u]"
+             : ",%u,%u,%u,%u,%u,%u,%u %u %u,"
+               "%02x %02x %02x %02x %02x %02x",
+        h->format, h->mark, h->length, h->pregap, h->echo_delay,
+        h->echo_pregap, h->echo_levels[0], h->echo_levels[1],
+        h->echo_levels[2], h->echo_pans[0], h->echo_pans[1], h->echo_pans[2],
+        h->echo_pans[3], h->echo_pans[4], h->echo_pans[5]);
+  } else if (!json) {
+    count += snprintf(&out[count], capacity - count, ",,,,,,,,");
+  }
+  if (channel_count > 0) {
+    count += snprintf(
+        &out[count], capacity - count,
+        json ? ",\"channels\":%u,\"duration\":%.3f,\"loop_length\":%lld,"
+               "\"loop_duration\":%.3f,\"expected_size\":%llu,"
+               "\"size_ok\":%s"
+             : ",%u,%.3f,%lld,%.3f,%llu,%s",
+        channel_count, (double)h->length / GAM_RATE, loop_length,
+        (double)loop_length / GAM_RATE, expected,
+        size_ok ? "true" : "false");
+  } else if (!json) {
+    count += snprintf(&out[count], capacity - count, ",,,,,,");
+  }
+  if (hash != NULL) {
+    snprintf(&out[count], capacity - count,
+             json ? ",\"hash\":\"%016llx\"}" EOL : ",%016llx" EOL,
+             (unsigned long long)*hash);
+  } else {
+    snprintf(&out[count], capacity - count, json ? "}" EOL : "," EOL);
+  }
+  free(strings[0]);
+  free(strings[1]);
+  return out;
+}
+
+/**
+ * Reads the header sector of the given file to the given buffer, and its size
+ * to the given location if known or `-1` otherwise. Returns the count of bytes
+ * read, or `-1` with `errno` set on failure.
+ */
+static long long gaminfo_probe(const char *name, uint8_t *sector,
+                               long long *size) {
+  long long out;
+  int errnoo;
+  *size = -1;
+#ifdef _WIN32
+  FILE *file = fopen(name, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+  out = fread(sector, 1, GAPCM_SECTOR_BYTES, file);
+  *size = fseeko(file, 0, SEEK_END) == SUCCESS ? ftello(file) : -1;
+  errnoo = errno;
+  fclose(file);
+#else
+  int fd = open(name, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat status;
+  *size = fstat(fd, &status) == SUCCESS ? status.st_size : -1;
+  out = pread(fd, sector, GAPCM_SECTOR_BYTES, 0);
+  errnoo = errno;
+  close(fd);
+#endif
+  errno = errnoo;
+  return out;
+}
+
+/** Returns a copy of the given string. */
+static char *gaminfo_string_copy(const char *string) {
+  char *out = malloc(strlen(string) + 1);
+  strcpy(out, string);
+  return out;
+}
+
+/** Compares the given catalog entries by path. */
+static int gaminfo_compare_entry(const void *a, const void *b) {
+  const struct GamInfoEntry *entries[] = {a, b};
+  return strcmp(entries[0]->path, entries[1]->path);
+}
+
+/** Returns the given count of bytes as a little-endian number. */
+static uint64_t gaminfo_get(const uint8_t *bytes, const size_t count) {
+  uint64_t out = 0;
+  for (size_t index = 0; index < count; index++) {
+    out |= (uint64_t)bytes[index] << (8 * index);
+  }
+  return out;
+}
+
+/** Puts the given number in the given count of bytes little-endian. */
+static void gaminfo_put(uint8_t *bytes, const uint64_t number,
+                        const size_t count) {
+  for (size_t index = 0; index < count; index++) {
+    bytes[index] = number >> (8 * index);
+  }
+}
+
+/**
+ * Decodes a catalog entry from the given bytes of the given count to the given
+ * location. Returns the count of bytes decoded, or `0` if too few.
+ */
+static size_t gaminfo_entry_decode(const uint8_t *bytes, const size_t count,
+                                   struct GamInfoEntry *entry) {
+  if (count < 2) {
+    return 0;
+  }
+  size_t length = gaminfo_get(bytes, 2);
+  if (count < GAMINFO_CATALOG_ENTRY_BYTES + length) {
+    return 0;
+  }
+  entry->path = malloc(length + 1);
+  memcpy(entry->path, &bytes[2], length);
+  entry->path[length] = '\0';
+  const uint8_t *b = &bytes[2 + length];
+  entry->size = gaminfo_get(b, 8);
+  entry->mtime = (long long)gaminfo_get(&b[8], 8);
+  entry->mtime_nanoseconds = gaminfo_get(&b[16], 4);
+  entry->hash = gaminfo_get(&b[20], 8);
+  entry->parsed = b[28] != 0;
+  struct GaPcmHeader *h = &entry->header;
+  h->format = gaminfo_get(&b[29], 2);
+  h->mark = gaminfo_get(&b[31], 4);
+  h->length = gaminfo_get(&b[35], 4);
+  memcpy(h->echo_pans, &b[39], 6);
+  h->echo_pregap = b[45];
+  h->echo_delay = b[46];
+  memcpy(h->echo_levels, &b[47], 3);
+  h->pregap = b[50];
+  return GAMINFO_CATALOG_ENTRY_BYTES + length;
+}
+
+/**
+ * Encodes the given catalog entry to the given bytes and returns their count.
+ * Paths longer than `UINT16_MAX` bytes are not encoded.
+ */
+static size_t gaminfo_entry_encode(const struct GamInfoEntry *entry,
+                                   uint8_t *bytes) {
+  size_t length = strlen(entry->path);
+  if (length > UINT16_MAX) {
+    return 0;
+  }
+  gaminfo_put(bytes, length, 2);
+  memcpy(&bytes[2], entry->path, length);
+  uint8_t *b = &bytes[2 + length];
+  gaminfo_put(b, entry->size, 8);
+  gaminfo_put(&b[8], (uint64_t)entry->mtime, 8);
+  gaminfo_put(&b[16], entry->mtime_nanoseconds, 4);
+  gaminfo_put(&b[20], entry->hash, 8);
+  b[28] = entry->parsed;
+  const struct GaPcmHeader *h = &entry->header;
+  gaminfo_put(&b[29], h->format, 2);
+  gaminfo_put(&b[31], h->mark, 4);
+  gaminfo_put(&b[35], h->length, 4);
+  memcpy(&b[39], h->echo_pans, 6);
+  b[45] = h->echo_pregap;
+  b[46] = h->echo_delay;
+  memcpy(&b[47], h->echo_levels, 3);
+  b[50] = h->pregap;
+  return GAMINFO_CATALOG_ENTRY_BYTES + length;
+}
+
+/** Frees the entries of the given catalog. */
+static void gaminfo_catalog_free(struct GamInfoCatalog *catalog) {
+  for (size_t index = 0; index < catalog->count; index++) {
+    free(catalog->entries[index].path);
+  }
+  free(catalog->entries);
+  *catalog = (struct GamInfoCatalog){NULL, 0, 0};
+}
+
+/**
+ * Loads the catalog of the given file name to the given location, empty if the
+ * file does not exist. Returns its success, with the given error set on
+ * failure.
+ */
+static bool gaminfo_catalog_load(const char *name,
+                                 struct GamInfoCatalog *catalog,
+                                 const char **error) {
+  FILE *file = fopen(name, "rb");
+  if (file == NULL) {
+    *error = strerror(errno);
+    // Made anew.
+    return errno == ENOENT;
+  }
+  long long count = -1;
+  if (fseeko(file, 0, SEEK_END) == SUCCESS) {
+    count = ftello(file);
+  }
+  uint8_t *bytes = NULL;
+  if (count >= 0 && fseeko(file, 0, SEEK_SET) == SUCCESS) {
+    bytes = malloc(count + 1);
+    if (fread(bytes, 1, count, file) != (unsigned long long)count) {
+      count = -1;
+    }
+  }
+  fclose(file);
+  *error = GAM_ERROR_READ;
+  if (count < 0) {
+    free(bytes);
+    return false;
+  }
+  *error = "Not a catalog.";
+  size_t magic = sizeof(GAMINFO_CATALOG_MAGIC) - 1;
+  if ((unsigned long long)count < magic + 8 ||
+      memcmp(bytes, GAMINFO_CATALOG_MAGIC, magic) != 0 ||
+      gaminfo_get(&bytes[magic], 4) != GAMINFO_CATALOG_VERSION) {
+    free(bytes);
+    return false;
+  }
+  catalog->capacity = gaminfo_get(&bytes[magic + 4], 4);
+  if (catalog->capacity >
+      (unsigned long long)count / GAMINFO_CATALOG_ENTRY_BYTES) {
+    catalog->capacity = 0;
+    free(bytes);
+    return false;
+  }
+  catalog->entries = malloc(sizeof(*catalog->entries) * catalog->capacity);
+  size_t position = magic + 8;
+  while (catalog->count < catalog->capacity) {
+    size_t length =
+        gaminfo_entry_decode(&bytes[position], count - position,
+                             &catalog->entries[catalog->count]);
+    if (length == 0) {
+      break;
+    }
+    catalog->count++;
+    position += length;
+  }
+  free(bytes);
+  if (catalog->count < catalog->capacity) {
+    gaminfo_catalog_free(catalog);
+    return false;
+  }
+  return true;
+}
+
+/** Adds the given entry to the given catalog. */
+static void gaminfo_catalog_push(struct GamInfoCatalog *catalog,
+                                 const struct GamInfoEntry *entry) {
+  if (catalog->count == catalog->capacity) {
+    catalog->capacity = catalog->capacity == 0 ? 64 : catalog->capacity * 2;
+    catalog->entries = realloc(catalog->entries,
+                               sizeof(*catalog->entries) * catalog->capacity);
+  }
+  catalog->entries[catalog->count++] = *entry;
+}
+
+/**
+ * Saves the given catalog to the given file name through a temporary file
+ * renamed over it. Returns its success, with `errno` set on failure.
+ */
+static bool gaminfo_catalog_save(const char *name,
+                                 const struct GamInfoCatalog *catalog) {
+  char *temporary = malloc(strlen(name) + sizeof(".tmp"));
+  sprintf(temporary, "%s.tmp", name);
+  FILE *file = fopen(temporary, "wb");
+  if (file == NULL) {
+    free(temporary);
+    return false;
+  }
+  size_t magic = sizeof(GAMINFO_CATALOG_MAGIC) - 1;
+  uint8_t *bytes = malloc(GAMINFO_CATALOG_ENTRY_BYTES + UINT16_MAX);
+  memcpy(bytes, GAMINFO_CATALOG_MAGIC, magic);
+  gaminfo_put(&bytes[magic], GAMINFO_CATALOG_VERSION, 4);
+  gaminfo_put(&bytes[magic + 4], catalog->count, 4);
+  bool out = fwrite(bytes, 1, magic + 8, file) == magic + 8;
+  for (size_t index = 0; out && index < catalog->count; index++) {
+    size_t count = gaminfo_entry_encode(&catalog->entries[index], bytes);
+    out = count > 0 && fwrite(bytes, 1, count, file) == count;
+  }
+  free(bytes);
+  out = fclose(file) == SUCCESS && out;
+#ifdef _WIN32
+  // Not replaced by renaming.
+  remove(name);
+#endif
+  if (!out || rename(temporary, name) != SUCCESS) {
+    int errnoo = errno;
+    remove(temporary);
+    errno = errnoo;
+    out = false;
+  }
+  free(temporary);
+  return out;
+}
+
+/**
+ * Scans the given file to the given entry. Its header and hash are taken from
+ * the given catalog if cataloged with the same size and modification time, and
+ * read otherwise, which is set to the given location. Returns its success, with
+ * `errno` set on failure.
+ */
+static bool gaminfo_scan(const char *name, const struct GamInfoCatalog *catalog,
+                         struct GamInfoEntry *entry, bool *reread) {
+  struct stat status;
+  if (stat(name, &status) != SUCCESS) {
+    return false;
+  }
+  // Also the key to look it up.
+  entry->path = gaminfo_string_copy(name);
+  entry->size = status.st_size;
+  entry->mtime = status.st_mtime;
+#ifdef _WIN32
+  entry->mtime_nanoseconds = 0;
+#else
+  entry->mtime_nanoseconds = status.st_mtim.tv_nsec;
+#endif
+  const struct GamInfoEntry *cataloged =
+      catalog->count == 0
+          ? NULL
+          : bsearch(entry, catalog->entries, catalog->count,
+                    sizeof(*catalog->entries), gaminfo_compare_entry);
+  *reread = cataloged == NULL || cataloged->size != entry->size ||
+            cataloged->mtime != entry->mtime ||
+            cataloged->mtime_nanoseconds != entry->mtime_nanoseconds;
+  if (!*reread) {
+    entry->hash = cataloged->hash;
+    entry->header = cataloged->header;
+    entry->parsed = cataloged->parsed;
+    return true;
+  }
+  FILE *file = fopen(name, "rb");
+  if (file == NULL) {
+    int errnoo = errno;
+    free(entry->path);
+    errno = errnoo;
+    return false;
+  }
+  // Read in whole buffers straight.
+  setvbuf(file, NULL, _IONBF, 0);
+  uint8_t *buffer = malloc(GAMINFO_HASH_CAPACITY);
+  size_t count;
+  entry->hash = 0xcbf29ce484222325ULL;
+  entry->parsed = false;
+  entry->size = 0;
+  while ((count = fread(buffer, 1, GAMINFO_HASH_CAPACITY, file)) > 0) {
+    if (entry->size == 0 && count >= GAPCM_SECTOR_BYTES) {
+      entry->parsed = gapcm_decode_header(buffer, &entry->header) ==
+                      GAPCM_SECTOR_BYTES;
+    }
+    for (size_t index = 0; index < count; index++) {
+      entry->hash = (entry->hash ^ buffer[index]) * 0x100000001b3ULL;
+    }
+    entry->size += count;
+  }
+  bool out = ferror(file) == 0;
+  int errnoo = errno;
+  fclose(file);
+  free(buffer);
+  if (!out) {
+    free(entry->path);
+  }
+  errno = errnoo;
+  return out;
+}
+
+/**
+ * Gets the given field of the record of the given catalog entry to the given
+ * location. Returns whether it has one.
+ */
+static bool gaminfo_value(const struct GamInfoEntry *entry,
+                          const enum GamInfoField field, double *value) {
+  const struct GaPcmHeader *h = &entry->header;
+  long long loop_length = 0;
+  unsigned long long expected = 0;
+  bool size_ok = false;
+  uint16_t channel_count =
+      entry->parsed ? gaminfo_derive(h, entry->size, &loop_length, &expected,
+                                     &size_ok)
+                    : 0;
+  if (field == SIZE || field == VALID) {
+    *value = field == SIZE ? entry->size
+                           : entry->parsed && gapcm_header_check(h, NULL);
+    return true;
+  }
+  if (!entry->parsed || (field >= CHANNELS && channel_count == 0)) {
+    return false;
+  }
+  switch (field) {
+  case FORMAT:
+    *value = h->format;
+    break;
+  case MARK:
+    *value = h->mark;
+    break;
+  case LENGTH:
+    *value = h->length;
+    break;
+  case PREGAP:
+    *value = h->pregap;
+    break;
+  case ECHO_DELAY:
+    *value = h->echo_delay;
+    break;
+  case ECHO_PREGAP:
+    *value = h->echo_pregap;
+    break;
+  case CHANNELS:
+    *value = channel_count;
+    break;
+  case DURATION:
+    *value = (double)h->length / GAM_RATE;
+    break;
+  case LOOP_LENGTH:
+    *value = loop_length;
+    break;
+  case LOOP_DURATION:
+    *value = (double)loop_length / GAM_RATE;
+    break;
+  case EXPECTED_SIZE:
+    *value = expected;
+    break;
+  case SIZE_OK:
+    *value = size_ok;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+/** Returns whether the given catalog entry matches every query term. */
+static bool gaminfo_match(const struct GamInfoEntry *entry) {
+  for (size_t index = 0; index < gaminfo_term_count; index++) {
+    const struct GamInfoTerm *term = &gaminfo_terms[index];
+    double value;
+    if (!gaminfo_value(entry, term->field, &value)) {
+      return false;
+    }
+    int comparison = value < term->value ? 1 : value > term->value ? 4 : 2;
+    if ((comparison & term->comparisons) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Parses the given query term of the given option and adds it. Returns its
+ * success.
+ */
+static int gaminfo_parse_term(const char *option, const char *term) {
+  static const char *OPERATORS[] = {"<=", ">=", "!=", "<", ">", "="};
+  static const int COMPARISONS[] = {3, 6, 5, 1, 4, 2};
+  struct GamInfoTerm out = {0, FIELD_COUNT, 0};
+  size_t length = strspn(term, "abcdefghijklmnopqrstuvwxyz_");
+  for (size_t index = 0; index < FIELD_COUNT; index++) {
+    if (strlen(GAMINFO_FIELDS[index]) == length &&
+        strncmp(term, GAMINFO_FIELDS[index], length) == 0) {
+      out.field = index;
+    }
+  }
+  for (size_t index = 0; out.comparisons == 0 && index < 6; index++) {
+    size_t count = strlen(OPERATORS[index]);
+    if (strncmp(&term[length], OPERATORS[index], count) == 0) {
+      out.comparisons = COMPARISONS[index];
+      length += count;
+    }
+  }
+  const char *number = &term[length];
+  bool parsed = string_equals_any(number, 2, "false", "true");
+  if (parsed) {
+    out.value = number[0] == 't';
+  } else {
+    char *end;
+    out.value = strtod(number, &end);
+    parsed = end != number && *end == '\0';
+  }
+  if (out.field == FIELD_COUNT || out.comparisons == 0 || !parsed) {
+    return application_error_argument_bad(
+        option, term, "Not `<field><operator><number>`.");
+  }
+  gaminfo_terms =
+      realloc(gaminfo_terms, sizeof(*gaminfo_terms) * (gaminfo_term_count + 1));
+  gaminfo_terms[gaminfo_term_count++] = out;
+  return EXIT_SUCCESS;
+}
+
 int gaminfo_error_options(void) {
   const char *message;
   int number = rand();
@@ -57,10 +776,69 @@ int gaminfo_error_options(void) {
   return EXIT_FAILURE;
 }
 
+/**
+ * Scans the source of the given instance to the rebuilt catalog. Returns
+ * failure if it can not be read.
+ */
+int gaminfo_act_catalog(struct GamInstance *i) {
+  struct GamInfoEntry entry;
+  bool reread;
+  if (!gaminfo_scan(i->options->source, &gaminfo_catalogs[0], &entry,
+                    &reread)) {
+    application_print_message(i->options->source, strerror(errno));
+    return EXIT_FAILURE;
+  }
+#ifndef _WIN32
+  pthread_mutex_lock(&gaminfo_lock);
+#endif
+  gaminfo_catalog_push(&gaminfo_catalogs[1], &entry);
+  gaminfo_reread_count += reread;
+#ifndef _WIN32
+  pthread_mutex_unlock(&gaminfo_lock);
+#endif
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Probes the source of the given instance and prints its record. Returns
+ * failure if its header is invalid.
+ */
+int gaminfo_act_record(struct GamInstance *i) {
+  uint8_t *sector = malloc(GAPCM_SECTOR_BYTES);
+  long long size;
+  const char *error = NULL;
+  bool parsed = false;
+  long long count = gaminfo_probe(i->options->source, sector, &size);
+  if (count < 0) {
+    error = strerror(errno);
+  } else if (count != GAPCM_SECTOR_BYTES ||
+             gapcm_decode_header(sector, i->header) != GAPCM_SECTOR_BYTES) {
+    error = GAM_ERROR_HEADER;
+  } else {
+    parsed = true;
+    gapcm_header_check(i->header, &error);
+  }
+  char *record =
+      gaminfo_record(i->options->source, size, parsed ? i->header : NULL,
+                     error, NULL,
+                     string_equals(i->options->format, GAMINFO_FORMAT_JSON));
+  // Whole, as records from other threads may be printed at once.
+  fputs(record, stdout);
+  free(record);
+  free(sector);
+  return error == NULL ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int gaminfo_act(struct GamInstance *i) {
   struct GaPcmHeader *h = i->header;
   char *o = i->options->output;
   int out = -1;
+  if (gaminfo_catalog_name != NULL) {
+    return gaminfo_act_catalog(i);
+  }
+  if (i->options->format != NULL) {
+    return gaminfo_act_record(i);
+  }
   if (i->options->has_mark) {
     out = printf("%u%s", GAPCM_SAMPLE_BYTES == 2 ? 1 : 0, EOL);
   } else if (o == NULL) {
@@ -90,10 +868,101 @@ int gaminfo_act(struct GamInstance *i) {
   return out > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+/**
+ * Saves the catalog rebuilt from the batch sources of the given instance if
+ * any, then prints the record of each cataloged file matching the query if
+ * any. Returns failure if it can not be saved.
+ */
+int gaminfo_catalog(struct GamInstance *i) {
+  int out = EXIT_SUCCESS;
+  struct GamInfoCatalog *catalog = &gaminfo_catalogs[0];
+  if (i->options->sources != NULL) {
+    catalog = &gaminfo_catalogs[1];
+    if (catalog->count > 0) {
+      qsort(catalog->entries, catalog->count, sizeof(*catalog->entries),
+            gaminfo_compare_entry);
+    }
+    // Files given twice are cataloged once.
+    size_t count = 0;
+    for (size_t index = 0; index < catalog->count; index++) {
+      if (count > 0 && gaminfo_compare_entry(&catalog->entries[count - 1],
+                                             &catalog->entries[index]) == 0) {
+        free(catalog->entries[index].path);
+      } else {
+        catalog->entries[count++] = catalog->entries[index];
+      }
+    }
+    catalog->count = count;
+    if (!gaminfo_catalog_save(gaminfo_catalog_name, catalog)) {
+      out = EXIT_FAILURE;
+      application_print_message(gaminfo_catalog_name, strerror(errno));
+    }
+    char string[96];
+    snprintf(string, sizeof(string), "%zu file(s) cataloged, %zu read.",
+             catalog->count, gaminfo_reread_count);
+    application_print_message(GAMINFO_APPINFO_NAME, string);
+  }
+  bool json = i->options->format == NULL ||
+              string_equals(i->options->format, GAMINFO_FORMAT_JSON);
+  for (size_t index = 0; gaminfo_term_count > 0 && index < catalog->count;
+       index++) {
+    const struct GamInfoEntry *entry = &catalog->entries[index];
+    if (!gaminfo_match(entry)) {
+      continue;
+    }
+    const char *error = entry->parsed ? NULL : GAM_ERROR_HEADER;
+    if (entry->parsed) {
+      gapcm_header_check(&entry->header, &error);
+    }
+    char *record =
+        gaminfo_record(entry->path, entry->size,
+                       entry->parsed ? &entry->header : NULL, error,
+                       &entry->hash, json);
+    fputs(record, stdout);
+    free(record);
+  }
+  return out;
+}
+
 int gaminfo_done(struct GamInstance *i) {
   return application_file_close(i->source, i->options->source);
 }
 
+int gaminfo_parse_catalog(struct ApplicationParseContext *c,
+                          struct GamOptions *options) {
+  const char *error = NULL;
+  int out = application_parse_string(c, &gaminfo_catalog_name);
+  if (out == EXIT_SUCCESS && !gaminfo_catalog_load(gaminfo_catalog_name,
+                                                   &gaminfo_catalogs[0],
+                                                   &error)) {
+    out = application_error_argument_bad(c->option, gaminfo_catalog_name,
+                                         error);
+  }
+  options->has_batch = out == EXIT_SUCCESS;
+  return out;
+}
+
+int gaminfo_parse_format(struct ApplicationParseContext *c,
+                         struct GamOptions *options) {
+  char *argument = NULL;
+  int out = application_parse_string(c, &argument);
+  if (out == EXIT_SUCCESS) {
+    if (string_equals(argument, GAMINFO_FORMAT_CSV)) {
+      options->format = GAMINFO_FORMAT_CSV;
+      puts(GAMINFO_RECORD_HEADING);
+    } else if (string_equals(argument, GAMINFO_FORMAT_JSON)) {
+      options->format = GAMINFO_FORMAT_JSON;
+    } else {
+      out = application_error_argument_bad(
+          c->option, argument,
+          "Not `" GAMINFO_FORMAT_CSV "` or `" GAMINFO_FORMAT_JSON "`.");
+    }
+  }
+  free(argument);
+  options->has_batch = out == EXIT_SUCCESS;
+  return out;
+}
+
 int gaminfo_parse_option(struct ApplicationParseContext *c,
                          struct GamOptions *options) {
   // GamOptions repurposing:
@@ -109,6 +978,27 @@ int gaminfo_parse_option(struct ApplicationParseContext *c,
   return EXIT_SUCCESS;
 }
 
+int gaminfo_parse_query(struct ApplicationParseContext *c,
+                        struct GamOptions *options) {
+  char *argument = NULL;
+  int out = application_parse_string(c, &argument);
+  if (out == EXIT_SUCCESS && gaminfo_catalog_name == NULL) {
+    out = application_error_argument_bad(c->option, argument,
+                                         "No catalog given before by `-C`.");
+  }
+  for (char *term = argument; out == EXIT_SUCCESS && term != NULL;) {
+    char *next = strchr(term, ',');
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+    out = gaminfo_parse_term(c->option, term);
+    term = next;
+  }
+  free(argument);
+  options->has_batch = out == EXIT_SUCCESS;
+  return out;
+}
+
 void gaminfo_print_header(void) {
   application_print_strings(
       1, GAMINFO_APPINFO_NAME SPACE APPINFO_VER SPACE
@@ -124,6 +1014,18 @@ int gaminfo_help(void) {
 }
 
 int gaminfo_read(struct GamInstance *i) {
+  if (gaminfo_catalog_name != NULL) {
+    if (i->options->source == NULL) {
+      gaminfo_query_only = true;
+      return GAM_EXIT_QUIT;
+    }
+    // Scanned in whole as it acts.
+    return EXIT_SUCCESS;
+  }
+  if (i->options->format != NULL) {
+    // Probed in whole as it acts.
+    return EXIT_SUCCESS;
+  }
   if (i->options->has_mark) {
     return i->options->length > 0 ? gaminfo_error_options() : EXIT_SUCCESS;
   }
@@ -156,7 +1058,7 @@ int gaminfo_read(struct GamInstance *i) {
   return out;
 }
 
-#define GAMINFO_OPTION_COUNT 9
+#define GAMINFO_OPTION_COUNT 13
 /** The main method is the entry point to this application. */
 int main(int argument_count, char *arguments[]) {
   if (argument_count < 2) {
@@ -167,6 +1069,8 @@ int main(int argument_count, char *arguments[]) {
   }
   srand(time(NULL));
   struct GamInstance *instance = gam_instance_make(arguments, argument_count);
+  instance->extension = ".pcm";
+  instance->name = GAMINFO_APPINFO_NAME;
   struct GamOption **options = malloc(sizeof(options) * GAMINFO_OPTION_COUNT);
   options[0] = gam_option_make("-c", "--channels", gaminfo_parse_option);
   options[1] = gam_option_make("-ea", "--echo-pans", gaminfo_parse_option);
@@ -177,8 +1081,21 @@ int main(int argument_count, char *arguments[]) {
   options[6] = gam_option_make("-n", "--length", gaminfo_parse_option);
   options[7] = gam_option_make("-p", "--pregap", gaminfo_parse_option);
   options[8] = gam_option_make("-bf", "--build-flags", gaminfo_parse_option);
+  options[9] = gam_option_make("-f", "--format", gaminfo_parse_format);
+  options[10] = gam_option_make("-j", "--threads", gam_parse_threads);
+  options[11] = gam_option_make("-C", "--catalog", gaminfo_parse_catalog);
+  options[12] = gam_option_make("-q", "--query", gaminfo_parse_query);
   int out = gam_run(instance, options, GAMINFO_OPTION_COUNT, gaminfo_help,
                     gaminfo_read, gaminfo_act, gaminfo_done);
+  if (gaminfo_catalog_name != NULL &&
+      (instance->options->sources != NULL || gaminfo_query_only)) {
+    int result = gaminfo_catalog(instance);
+    out = out == EXIT_SUCCESS ? result : out;
+  }
+  gaminfo_catalog_free(&gaminfo_catalogs[0]);
+  gaminfo_catalog_free(&gaminfo_catalogs[1]);
+  free(gaminfo_catalog_name);
+  free(gaminfo_terms);
   instance = gam_instance_free(instance);
   for (size_t index = 0; index < GAMINFO_OPTION_COUNT; index++) {
     options[index] = gam_option_free(options[index]);
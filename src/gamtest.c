@@ -2,12 +2,23 @@
  * GAPCM: Unit Tests
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "common/constants.h"
 #include "common/math.h"
 #include "gapcm/gapcm.h"
+#include "gapcm/simd.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
+#define GAMTEST_BUFFER_FRAMES 3001
+#define GAMTEST_BUFFER_LOOPS 3
+#define GAMTEST_PREFETCH_FRAMES 400000
 #define GAMTEST_SECTOR_BYTES 4
 
 #define O GAPCM_SAMPLE_ORIGIN
@@ -82,6 +93,742 @@ void gamtest_sector(const uint8_t *sector) {
   }
 }
 
+void gamtest_kernels(void) {
+  uint8_t sector[GAPCM_SECTOR_BYTES];
+  for (size_t index = 0; index < GAPCM_SECTOR_BYTES; index++) {
+    sector[index] = index * 167 + (index >> 8);
+  }
+  uint8_t answer[GAPCM_SECTOR_BYTES];
+  uint8_t decode[GAPCM_BLOCK_BYTES];
+  uint8_t encode[GAPCM_SECTOR_BYTES];
+  for (size_t kernel = 0; kernel < gapcm_simd_kernel_count; kernel++) {
+    const struct GaPcmSimdKernel *k = &gapcm_simd_kernels[kernel];
+    bool supported = k->SUPPORTED();
+    printf("  %-6s %s%s" EOL, k->NAME, supported ? "supported" : "unsupported",
+           k == gapcm_simd_kernel() ? ", selected" : "");
+    if (!supported) {
+      continue;
+    }
+    for (size_t count = 0; count <= GAPCM_SECTOR_BYTES; count++) {
+      size_t answer_count = gapcm_simd_decode_sector(sector, count, answer);
+      assert(k->DECODE(sector, count, decode) == answer_count);
+      for (size_t index = 0; index < answer_count; index++) {
+        assert(decode[index] == answer[index]);
+      }
+    }
+    for (size_t count = 0; count <= GAPCM_BLOCK_BYTES; count++) {
+      size_t answer_count = gapcm_simd_encode_sector(sector, count, answer);
+      assert(k->ENCODE(sector, count, encode) == answer_count);
+      for (size_t index = 0; index < answer_count; index++) {
+        assert(encode[index] == answer[index]);
+      }
+    }
+    for (size_t count = 0; count <= GAPCM_BLOCK_BYTES / 2;
+         count += GAPCM_SAMPLE_BYTES) {
+      gapcm_simd_interleave(sector, &sector[GAPCM_BLOCK_BYTES / 2], count,
+                            answer);
+      k->INTERLEAVE(sector, &sector[GAPCM_BLOCK_BYTES / 2], count, encode);
+      for (size_t index = 0; index < 2 * count; index++) {
+        assert(encode[index] == answer[index]);
+      }
+      k->DEINTERLEAVE(answer, count, decode, &decode[GAPCM_BLOCK_BYTES / 2]);
+      for (size_t index = 0; index < count; index++) {
+        assert(decode[index] == sector[index]);
+        assert(decode[GAPCM_BLOCK_BYTES / 2 + index] ==
+               sector[GAPCM_BLOCK_BYTES / 2 + index]);
+      }
+    }
+  }
+}
+
+/** Reads the given file from its start to a new buffer of the given count. */
+uint8_t *gamtest_file_read(FILE *file, const size_t count) {
+  uint8_t *out = malloc(count);
+  rewind(file);
+  size_t count_read = fread(out, 1, count, file);
+  assert(count_read == count);
+  return out;
+}
+
+void gamtest_buffers(const uint16_t channel_count) {
+  struct GaPcmHeader header = {.format = gapcm_to_format(channel_count),
+                               .mark = channel_count,
+                               .length = GAMTEST_BUFFER_FRAMES};
+  size_t pcm_count = GAPCM_SAMPLE_BYTES * channel_count * GAMTEST_BUFFER_FRAMES;
+  uint8_t *pcm = malloc(pcm_count);
+  for (size_t index = 0; index < pcm_count; index++) {
+    pcm[index] = index * 167 + (index >> 8);
+  }
+  FILE *source = tmpfile();
+  FILE *output = tmpfile();
+  size_t count_write = fwrite(pcm, 1, pcm_count, source);
+  assert(count_write == pcm_count);
+  rewind(source);
+  size_t sectors_count = gapcm_encode_stream_for(
+      &header, source, output, GAPCM_SAMPLE_BYTES * GAMTEST_BUFFER_FRAMES);
+  uint8_t *sectors = gamtest_file_read(output, sectors_count);
+  struct GaPcmSession *session = gapcm_session_make(&header);
+  uint8_t *buffer = malloc(sectors_count);
+  struct GaPcmBuffers b = {pcm, buffer, 0, 0, false};
+  size_t count = 0;
+  while (b.source_count > 0 || !b.source_end) {
+    size_t count_source = pcm_count - (b.source - pcm) - b.source_count;
+    b.source_count += count_source < 777 ? count_source : 777;
+    b.source_end = b.source - pcm + b.source_count == pcm_count;
+    b.output_count = sectors_count - count < 3 * GAPCM_SECTOR_BYTES
+                         ? sectors_count - count
+                         : 3 * GAPCM_SECTOR_BYTES;
+    // Counts are in bytes of each channel.
+    count += gapcm_session_encode_buffer_for(
+        session, &b,
+        GAPCM_SAMPLE_BYTES * GAMTEST_BUFFER_FRAMES -
+            (b.source - pcm) / channel_count);
+  }
+  printf("  encode %u channel(s): %zu of %zu bytes" EOL, channel_count, count,
+         sectors_count);
+  assert(count == sectors_count);
+  for (size_t index = 0; index < count; index++) {
+    assert(buffer[index] == sectors[index]);
+  }
+  free(buffer);
+  fclose(output);
+  output = tmpfile();
+  // Seeks skip a header sector.
+  fseek(source, GAPCM_SECTOR_BYTES, SEEK_SET);
+  count_write = fwrite(sectors, 1, sectors_count, source);
+  assert(count_write == sectors_count);
+  fseek(source, GAPCM_SECTOR_BYTES, SEEK_SET);
+  size_t frames_count =
+      gapcm_decode_stream(&header, source, output, GAMTEST_BUFFER_LOOPS);
+  uint8_t *frames = gamtest_file_read(output, frames_count);
+  buffer = malloc(frames_count);
+  b = (struct GaPcmBuffers){sectors, buffer, sectors_count, frames_count, true};
+  count = gapcm_session_decode_buffer(session, &b, GAMTEST_BUFFER_LOOPS);
+  printf("  decode %u channel(s): %zu of %zu bytes" EOL, channel_count, count,
+         frames_count);
+  assert(count == frames_count);
+  for (size_t index = 0; index < count; index++) {
+    assert(buffer[index] == frames[index]);
+  }
+  b = (struct GaPcmBuffers){sectors, buffer, 0, 0, false};
+  count = 0;
+  while (count < GAPCM_SAMPLE_BYTES * channel_count * GAMTEST_BUFFER_FRAMES) {
+    size_t count_source = sectors_count - (b.source - sectors) - b.source_count;
+    b.source_count += count_source < 3000 ? count_source : 3000;
+    b.source_end = b.source - sectors + b.source_count == sectors_count;
+    b.output_count = 3 * GAPCM_BLOCK_BYTES;
+    count += gapcm_session_decode_buffer_for(
+        session, &b,
+        GAPCM_SAMPLE_BYTES * GAMTEST_BUFFER_FRAMES - count / channel_count);
+  }
+  assert(count == GAPCM_SAMPLE_BYTES * channel_count * GAMTEST_BUFFER_FRAMES);
+  for (size_t index = 0; index < count; index++) {
+    assert(buffer[index] == frames[index]);
+  }
+  session = gapcm_session_free(session);
+  free(buffer);
+  free(frames);
+  free(sectors);
+  free(pcm);
+  fclose(output);
+  fclose(source);
+}
+
+/**
+ * Writes a stream of the given header and the given count of frames to a new
+ * file, and leaves it at the stream start.
+ */
+FILE *gamtest_stream(struct GaPcmHeader *header, const uint32_t count) {
+  uint16_t channel_count = gapcm_to_channelcount(header->format);
+  size_t pcm_count = GAPCM_SAMPLE_BYTES * channel_count * count;
+  FILE *pcm = tmpfile();
+  for (size_t index = 0; index < pcm_count; index++) {
+    fputc((uint8_t)(index * 167 + (index >> 8)), pcm);
+  }
+  rewind(pcm);
+  FILE *out = tmpfile();
+  uint8_t sector[GAPCM_SECTOR_BYTES];
+  gapcm_encode_header(header, sector);
+  fwrite(sector, 1, GAPCM_SECTOR_BYTES, out);
+  gapcm_encode_stream_for(header, pcm, out, count);
+  fclose(pcm);
+  fseek(out, GAPCM_SECTOR_BYTES, SEEK_SET);
+  return out;
+}
+
+void gamtest_decoder(const uint16_t channel_count, const int loop_count,
+                     const bool trail) {
+  struct GaPcmHeader header = {.format = gapcm_to_format(channel_count),
+                               .mark = channel_count,
+                               .length = GAMTEST_BUFFER_FRAMES,
+                               .pregap = 2};
+  FILE *source = gamtest_stream(&header, GAMTEST_BUFFER_FRAMES + 1500);
+  FILE *output = tmpfile();
+  // As the decoder application does.
+  size_t answer_count = gapcm_decode_pregap(header.pregap, output);
+  if (!trail) {
+    answer_count += gapcm_decode_stream(&header, source, output, loop_count);
+  } else if (loop_count > 1) {
+    answer_count +=
+        gapcm_decode_stream(&header, source, output, loop_count - 1);
+    int status = gapcm_decode_seek(source, header.mark);
+    assert(status == SUCCESS);
+    answer_count +=
+        gapcm_decode_stream_for(&header, source, output, UINT32_MAX);
+  } else {
+    answer_count +=
+        gapcm_decode_stream_for(&header, source, output, UINT32_MAX);
+  }
+  uint8_t *answer = gamtest_file_read(output, answer_count);
+  fseek(source, 0, SEEK_END);
+  struct GaPcmPlan plan;
+  unsigned long long count_plan =
+      gapcm_decode_plan(&header, ftell(source), loop_count, trail, &plan);
+  assert(count_plan == answer_count);
+  assert(plan.whole);
+  for (size_t index = 1; index < plan.part_count; index++) {
+    assert(plan.parts[index].offset == plan.parts[index - 1].offset +
+                                           plan.parts[index - 1].segment.count);
+  }
+  fseek(source, GAPCM_SECTOR_BYTES, SEEK_SET);
+  clearerr(source);
+  struct GaPcmSession *session = gapcm_session_make(&header);
+  struct GaPcmDecoder *decoder =
+      gapcm_decoder_make(session, source, loop_count, trail);
+  size_t count = 0;
+  enum GaPcmDecoderPhase phase = GAPCM_PHASE_PREGAP;
+  const uint8_t *frames;
+  size_t count_frames;
+  while ((count_frames = gapcm_decoder_next(decoder, 300, &frames)) > 0) {
+    assert(count_frames <= GAPCM_SAMPLE_BYTES * channel_count * 300);
+    assert(gapcm_decoder_phase(decoder) >= phase);
+    phase = gapcm_decoder_phase(decoder);
+    assert(count + count_frames <= answer_count);
+    for (size_t index = 0; index < count_frames; index++) {
+      assert(frames[index] == answer[count + index]);
+    }
+    count += count_frames;
+  }
+  printf("  %u channel(s), %d loop(s)%s: %zu of %zu bytes" EOL, channel_count,
+         loop_count, trail ? ", trail" : "", count, answer_count);
+  assert(count == answer_count);
+  assert(gapcm_decoder_phase(decoder) == GAPCM_PHASE_DONE);
+  size_t frame_count = answer_count / (GAPCM_SAMPLE_BYTES * channel_count);
+  for (size_t seek = 0; seek <= 64; seek++) {
+    // Scattered frames, then the output end.
+    size_t frame = seek < 64 ? seek * 7919 % frame_count : frame_count;
+    count = GAPCM_SAMPLE_BYTES * channel_count * frame;
+    bool seeked = gapcm_decoder_seek(decoder, frame);
+    assert(seeked == (count < answer_count));
+    while ((count_frames = gapcm_decoder_next(decoder, 300, &frames)) > 0) {
+      assert(count + count_frames <= answer_count);
+      for (size_t index = 0; index < count_frames; index++) {
+        assert(frames[index] == answer[count + index]);
+      }
+      count += count_frames;
+    }
+    assert(count == answer_count);
+  }
+  decoder = gapcm_decoder_free(decoder);
+  session = gapcm_session_free(session);
+  free(answer);
+  fclose(output);
+  fclose(source);
+}
+
+void gamtest_io(const uint16_t channel_count) {
+  struct GaPcmHeader header = {.format = gapcm_to_format(channel_count),
+                               .mark = channel_count,
+                               .length = GAMTEST_BUFFER_FRAMES};
+  FILE *source = gamtest_stream(&header, GAMTEST_BUFFER_FRAMES);
+  FILE *output = tmpfile();
+  size_t answer_count =
+      gapcm_decode_stream(&header, source, output, GAMTEST_BUFFER_LOOPS);
+  uint8_t *answer = gamtest_file_read(output, answer_count);
+  fseek(source, 0, SEEK_END);
+  size_t stream_count = ftell(source);
+  uint8_t *stream = gamtest_file_read(source, stream_count);
+  struct GaPcmIoMemory memories[] = {{stream, stream_count, GAPCM_SECTOR_BYTES},
+                                     {malloc(answer_count), answer_count, 0}};
+  struct GaPcmIo ios[2];
+  struct GaPcmSession *session = gapcm_session_make(&header);
+  size_t count = gapcm_session_decode_io(
+      session, gapcm_io_memory(&ios[0], &memories[0]),
+      gapcm_io_memory(&ios[1], &memories[1]), GAMTEST_BUFFER_LOOPS);
+  printf("  memory %u channel(s): %zu of %zu bytes" EOL, channel_count, count,
+         answer_count);
+  assert(count == answer_count);
+  for (size_t index = 0; index < count; index++) {
+    assert(memories[1].bytes[index] == answer[index]);
+  }
+#ifndef _WIN32
+  fclose(output);
+  output = tmpfile();
+  gapcm_io_fd(&ios[0], fileno(source));
+  int status = ios[0].SEEK(ios[0].user, GAPCM_SECTOR_BYTES);
+  assert(status == SUCCESS);
+  assert(ios[0].TELL(ios[0].user) == GAPCM_SECTOR_BYTES);
+  ios[0].PREFETCH(ios[0].user, GAPCM_SECTOR_BYTES, stream_count);
+  count = gapcm_session_decode_io(session, &ios[0],
+                                  gapcm_io_fd(&ios[1], fileno(output)),
+                                  GAMTEST_BUFFER_LOOPS);
+  printf("  fd     %u channel(s): %zu of %zu bytes" EOL, channel_count, count,
+         answer_count);
+  assert(count == answer_count);
+  uint8_t *frames = gamtest_file_read(output, count);
+  for (size_t index = 0; index < count; index++) {
+    assert(frames[index] == answer[index]);
+  }
+  free(frames);
+  status = ios[1].SEEK(ios[1].user, answer_count);
+  assert(status == SUCCESS);
+  count = gapcm_io_fd_repeat(fileno(output), answer_count, answer_count, 2);
+  printf("  repeat %u channel(s): %zu of %zu bytes" EOL, channel_count, count,
+         2 * answer_count);
+  assert(count == 2 * answer_count);
+  assert(ios[1].TELL(ios[1].user) == (long long)answer_count);
+  frames = gamtest_file_read(output, 3 * answer_count);
+  for (size_t index = 0; index < 3 * answer_count; index++) {
+    assert(frames[index] == answer[index % answer_count]);
+  }
+  free(frames);
+  struct GaPcmIoMemory map;
+  bool mapped = gapcm_io_memory_map(&map, fileno(source));
+  assert(mapped);
+  assert(map.count == stream_count);
+  map.position = GAPCM_SECTOR_BYTES;
+  gapcm_io_memory(&ios[0], &map)->PREFETCH(&map, 0, 2 * stream_count);
+  memories[1].position = 0;
+  memset(memories[1].bytes, 0, answer_count);
+  count = gapcm_session_decode_io(session, gapcm_io_memory(&ios[0], &map),
+                                  gapcm_io_memory(&ios[1], &memories[1]),
+                                  GAMTEST_BUFFER_LOOPS);
+  printf("  map    %u channel(s): %zu of %zu bytes" EOL, channel_count, count,
+         answer_count);
+  assert(count == answer_count);
+  for (size_t index = 0; index < count; index++) {
+    assert(memories[1].bytes[index] == answer[index]);
+  }
+  gapcm_io_memory_unmap(&map);
+  assert(map.bytes == NULL);
+  int pipes[2];
+  status = pipe(pipes);
+  assert(status == SUCCESS);
+  mapped = gapcm_io_memory_map(&map, pipes[0]);
+  assert(!mapped);
+#ifdef __linux__
+  struct GaPcmIoPipe *pipe = gapcm_io_pipe_make(fileno(source));
+  assert(pipe == NULL);
+  pipe = gapcm_io_pipe_make(pipes[1]);
+  assert(pipe != NULL);
+  memories[0].position = GAPCM_SECTOR_BYTES;
+  count = gapcm_session_decode_io(
+      session, gapcm_io_memory(&ios[0], &memories[0]),
+      gapcm_io_pipe(&ios[1], pipe), GAMTEST_BUFFER_LOOPS);
+  bool flushed = gapcm_io_pipe_flush(pipe);
+  assert(flushed);
+  printf("  pipe   %u channel(s): %zu of %zu bytes" EOL, channel_count, count,
+         answer_count);
+  assert(count == answer_count);
+  memset(memories[1].bytes, 0, answer_count);
+  ssize_t count_read = read(pipes[0], memories[1].bytes, answer_count);
+  assert(count_read == (ssize_t)answer_count);
+  for (size_t index = 0; index < count; index++) {
+    assert(memories[1].bytes[index] == answer[index]);
+  }
+  pipe = gapcm_io_pipe_free(pipe);
+  struct GaPcmIoUring *urings[] = {gapcm_io_uring_make(pipes[0], 0, false),
+                                   NULL};
+  assert(urings[0] == NULL);
+  fclose(output);
+  output = tmpfile();
+  urings[0] = gapcm_io_uring_make(fileno(source), GAPCM_SECTOR_BYTES, false);
+  urings[1] = gapcm_io_uring_make(fileno(output), 0, true);
+  if (urings[0] != NULL && urings[1] != NULL) {
+    count = gapcm_session_decode_io(session, gapcm_io_uring(&ios[0], urings[0]),
+                                    gapcm_io_uring(&ios[1], urings[1]),
+                                    GAMTEST_BUFFER_LOOPS);
+    flushed = gapcm_io_uring_flush(urings[1]);
+    assert(flushed);
+    printf("  uring  %u channel(s): %zu of %zu bytes" EOL, channel_count,
+           count, answer_count);
+    assert(count == answer_count);
+    frames = gamtest_file_read(output, count);
+    for (size_t index = 0; index < count; index++) {
+      assert(frames[index] == answer[index]);
+    }
+    free(frames);
+  } else {
+    printf("  uring  %u channel(s): unavailable" EOL, channel_count);
+  }
+  urings[0] = gapcm_io_uring_free(urings[0]);
+  urings[1] = gapcm_io_uring_free(urings[1]);
+#endif
+  close(pipes[0]);
+  close(pipes[1]);
+#endif
+  session = gapcm_session_free(session);
+  free(memories[1].bytes);
+  free(stream);
+  free(answer);
+  fclose(output);
+  fclose(source);
+}
+
+/** Represents a looped stream with its serial transcodes. */
+struct GamtestFixture {
+  /** Stream header. */
+  struct GaPcmHeader header;
+  /** Stream file at its first block. */
+  FILE *source;
+  /** Stream bytes, header sector included. */
+  uint8_t *stream;
+  /** Count of stream bytes. */
+  size_t stream_count;
+  /** Serial decode of `GAMTEST_BUFFER_LOOPS` loops. */
+  uint8_t *answer;
+  /** Count of serial decode bytes. */
+  size_t answer_count;
+  /** Serial encode of the serial decode. */
+  uint8_t *sectors;
+  /** Count of serial encode bytes. */
+  size_t sectors_count;
+};
+
+/** Fixture layouts as marks in blocks then lengths in frames. */
+static const uint32_t gamtest_layouts[][2] = {
+    {2, GAMTEST_BUFFER_FRAMES},
+    // Odd count of sectors per channel, the last one whole.
+    {2, 5 * GAPCM_BLOCK_SAMPLES},
+    // Last sector of a single sample.
+    {2, 4 * GAPCM_BLOCK_SAMPLES + 1},
+    // Odd mark, which splits a stereo sector group.
+    {1, GAMTEST_BUFFER_FRAMES}};
+
+/**
+ * Makes the given fixture for the given channel count and layout of the given
+ * mark in blocks and length in frames.
+ */
+void gamtest_fixture_make(struct GamtestFixture *f,
+                          const uint16_t channel_count, const uint32_t mark,
+                          const uint32_t length) {
+  f->header = (struct GaPcmHeader){.format = gapcm_to_format(channel_count),
+                                   .mark = mark,
+                                   .length = length};
+  f->source = gamtest_stream(&f->header, length);
+  FILE *output = tmpfile();
+  f->answer_count = gapcm_decode_stream(&f->header, f->source, output,
+                                        GAMTEST_BUFFER_LOOPS);
+  f->answer = gamtest_file_read(output, f->answer_count);
+  fclose(output);
+  output = tmpfile();
+  struct GaPcmIoMemory pcm = {f->answer, f->answer_count, 0};
+  struct GaPcmIo ios[2];
+  struct GaPcmSession *session = gapcm_session_make(&f->header);
+  f->sectors_count =
+      gapcm_session_encode_io(session, gapcm_io_memory(&ios[0], &pcm),
+                              gapcm_io_fd(&ios[1], fileno(output)));
+  f->sectors = gamtest_file_read(output, f->sectors_count);
+  session = gapcm_session_free(session);
+  fclose(output);
+  fseek(f->source, 0, SEEK_END);
+  f->stream_count = ftell(f->source);
+  f->stream = gamtest_file_read(f->source, f->stream_count);
+  fseek(f->source, GAPCM_SECTOR_BYTES, SEEK_SET);
+}
+
+/** Frees the given fixture. */
+void gamtest_fixture_free(struct GamtestFixture *f) {
+  free(f->sectors);
+  free(f->stream);
+  free(f->answer);
+  fclose(f->source);
+}
+
+/**
+ * Serially decodes the given fixture from its stream cut to the given count of
+ * bytes to a new buffer of the given capacity and returns its count of bytes.
+ */
+size_t gamtest_fixture_short(const struct GamtestFixture *f,
+                             const size_t stream_count, const size_t capacity,
+                             uint8_t **bytes) {
+  struct GaPcmIoMemory memories[] = {
+      {f->stream, stream_count, GAPCM_SECTOR_BYTES},
+      {malloc(capacity), capacity, 0}};
+  struct GaPcmIo ios[2];
+  struct GaPcmSession *session = gapcm_session_make(&f->header);
+  size_t out = gapcm_session_decode_io(
+      session, gapcm_io_memory(&ios[0], &memories[0]),
+      gapcm_io_memory(&ios[1], &memories[1]), GAMTEST_BUFFER_LOOPS);
+  session = gapcm_session_free(session);
+  *bytes = memories[1].bytes;
+  return out;
+}
+
+/**
+ * Asserts that the given file holds the given bytes from the given offset on.
+ */
+void gamtest_file_compare(FILE *file, const size_t offset,
+                          const uint8_t *bytes, const size_t count) {
+  uint8_t *frames = gamtest_file_read(file, offset + count);
+  for (size_t index = 0; index < count; index++) {
+    assert(frames[offset + index] == bytes[index]);
+  }
+  free(frames);
+}
+
+/** Runs the given test over each fixture layout, mono then stereo. */
+void gamtest_fixtures(void (*test)(const struct GamtestFixture *)) {
+  size_t layout_count = sizeof(gamtest_layouts) / sizeof(*gamtest_layouts);
+  for (uint16_t channel_count = 1; channel_count <= 2; channel_count++) {
+    for (size_t index = 0; index < layout_count; index++) {
+      struct GamtestFixture f;
+      gamtest_fixture_make(&f, channel_count, gamtest_layouts[index][0],
+                           gamtest_layouts[index][1]);
+      printf("  %u channel(s), mark %u, length %u:" EOL, channel_count,
+             f.header.mark, f.header.length);
+      test(&f);
+      gamtest_fixture_free(&f);
+    }
+  }
+}
+
+void gamtest_loops(const struct GamtestFixture *f) {
+  // None, in memory, and spilled past the capacity.
+  const size_t capacities[] = {0, GAPCM_LOOP_CACHE_BYTES, 1};
+  const char *names[] = {"none", "memory", "spilled"};
+  const int loop_counts[] = {GAMTEST_BUFFER_LOOPS, GAPCM_LOOP_FOREVER};
+  for (size_t index = 0; index < 6; index++) {
+    int loop_count = loop_counts[index % 2];
+    // Endless loops stop at the end of a bounded output, mid-loop.
+    size_t capacity = loop_count == GAPCM_LOOP_FOREVER ? f->answer_count - 1
+                                                       : f->answer_count;
+    struct GaPcmIoMemory memories[] = {
+        {f->stream, f->stream_count, GAPCM_SECTOR_BYTES},
+        {calloc(capacity, 1), capacity, 0}};
+    struct GaPcmIo ios[2];
+    struct GaPcmSession *session = gapcm_session_make(&f->header);
+    size_t capacity_cache = gapcm_session_cache(session, capacities[index / 2]);
+    assert(capacity_cache == capacities[index / 2]);
+    size_t count = gapcm_session_decode_io(
+        session, gapcm_io_memory(&ios[0], &memories[0]),
+        gapcm_io_memory(&ios[1], &memories[1]), loop_count);
+    printf("    cache %-7s %s: %zu of %zu bytes" EOL, names[index / 2],
+           loop_count == GAPCM_LOOP_FOREVER ? "forever" : "looped", count,
+           capacity);
+    assert(count == capacity);
+    for (size_t position = 0; position < count; position++) {
+      assert(memories[1].bytes[position] == f->answer[position]);
+    }
+    session = gapcm_session_free(session);
+    free(memories[1].bytes);
+  }
+}
+
+/** Represents a source that records its reads ahead. */
+struct GamtestPrefetch {
+  /** Source memory. */
+  struct GaPcmIoMemory memory;
+  /** Memory adapter. */
+  struct GaPcmIo io;
+  /** Source positions at each read ahead. */
+  size_t positions[GAMTEST_BUFFER_LOOPS];
+  /** Offsets of each read ahead. */
+  unsigned long long offsets[GAMTEST_BUFFER_LOOPS];
+  /** Count of reads ahead. */
+  size_t count;
+};
+
+size_t gamtest_prefetch_read(void *user, void *bytes, const size_t count) {
+  struct GamtestPrefetch *p = user;
+  return p->io.READ(p->io.user, bytes, count);
+}
+
+int gamtest_prefetch_seek(void *user, const unsigned long long offset) {
+  struct GamtestPrefetch *p = user;
+  return p->io.SEEK(p->io.user, offset);
+}
+
+void gamtest_prefetch_prefetch(void *user, const unsigned long long offset,
+                               [[maybe_unused]] const size_t count) {
+  struct GamtestPrefetch *p = user;
+  if (p->count < GAMTEST_BUFFER_LOOPS) {
+    p->positions[p->count] = p->memory.position;
+    p->offsets[p->count] = offset;
+  }
+  p->count++;
+}
+
+void gamtest_prefetch(const uint16_t channel_count, const bool pipeline) {
+  struct GaPcmHeader header = {.format = gapcm_to_format(channel_count),
+                               .mark = channel_count,
+                               .length = GAMTEST_PREFETCH_FRAMES};
+  FILE *source = gamtest_stream(&header, GAMTEST_PREFETCH_FRAMES);
+  fseek(source, 0, SEEK_END);
+  size_t stream_count = ftell(source);
+  struct GamtestPrefetch prefetch = {
+      .memory = {gamtest_file_read(source, stream_count), stream_count,
+                 GAPCM_SECTOR_BYTES}};
+  gapcm_io_memory(&prefetch.io, &prefetch.memory);
+  struct GaPcmIo ios[] = {{.READ = gamtest_prefetch_read,
+                           .SEEK = gamtest_prefetch_seek,
+                           .PREFETCH = gamtest_prefetch_prefetch,
+                           .user = &prefetch},
+                          {0}};
+  size_t mark = GAPCM_BLOCK_BYTES * header.mark;
+  size_t answer_count =
+      mark + GAMTEST_BUFFER_LOOPS *
+                 (GAPCM_SAMPLE_BYTES * header.length * channel_count - mark);
+  struct GaPcmIoMemory output = {malloc(answer_count), answer_count, 0};
+  struct GaPcmSession *session = gapcm_session_make(&header);
+  gapcm_session_pipeline(session, pipeline);
+  size_t count = gapcm_session_decode_io(session, &ios[0],
+                                         gapcm_io_memory(&ios[1], &output),
+                                         GAMTEST_BUFFER_LOOPS);
+  printf("  %u channel(s)%s: %zu of %zu reads ahead" EOL, channel_count,
+         pipeline ? ", pipeline" : "", prefetch.count,
+         (size_t)GAMTEST_BUFFER_LOOPS - 1);
+  assert(count == answer_count);
+  // Once per loop end that seeks back, late in the loop.
+  assert(prefetch.count == GAMTEST_BUFFER_LOOPS - 1);
+  size_t offset = GAPCM_SECTOR_BYTES * (1 + header.mark);
+  for (size_t index = 0; index < prefetch.count; index++) {
+    printf("    at %zu of [%zu, %zu] bytes" EOL, prefetch.positions[index],
+           offset, stream_count);
+    assert(prefetch.offsets[index] == offset);
+    assert(prefetch.positions[index] > offset + (stream_count - offset) / 2);
+    assert(prefetch.positions[index] < stream_count);
+  }
+  session = gapcm_session_free(session);
+  free(output.bytes);
+  free(prefetch.memory.bytes);
+  fclose(source);
+}
+
+void gamtest_pipeline(const struct GamtestFixture *f) {
+  uint8_t *answer_short;
+  size_t answer_short_count = gamtest_fixture_short(
+      f, f->stream_count, f->answer_count / 2, &answer_short);
+  struct GaPcmSession *session = gapcm_session_make(&f->header);
+  if (!gapcm_session_pipeline(session, true)) {
+    puts("    unsupported");
+  }
+  FILE *output = tmpfile();
+  fseek(f->source, GAPCM_SECTOR_BYTES, SEEK_SET);
+  size_t count = gapcm_session_decode_stream(session, f->source, output,
+                                             GAMTEST_BUFFER_LOOPS);
+  printf("    decode: %zu of %zu bytes" EOL, count, f->answer_count);
+  assert(count == f->answer_count);
+  gamtest_file_compare(output, 0, f->answer, count);
+  struct GaPcmIoMemory memory = {malloc(f->answer_count / 2),
+                                 f->answer_count / 2, 0};
+  struct GaPcmIo ios[2];
+  gapcm_io_memory(&ios[1], &memory);
+  gapcm_io_file(&ios[0], f->source);
+  ios[0].SEEK(ios[0].user, GAPCM_SECTOR_BYTES);
+  count =
+      gapcm_session_decode_io(session, &ios[0], &ios[1], GAMTEST_BUFFER_LOOPS);
+  printf("    short:  %zu of %zu bytes" EOL, count, answer_short_count);
+  assert(count == answer_short_count);
+  for (size_t index = 0; index < count; index++) {
+    assert(memory.bytes[index] == answer_short[index]);
+  }
+  // The final group is cut to the samples of the first channel that the length
+  // takes, so later channels are filled with origin samples.
+  uint16_t channel_count = gapcm_to_channelcount(f->header.format);
+  size_t cut_count =
+      GAPCM_SECTOR_BYTES *
+          (1 + f->header.length / GAPCM_BLOCK_SAMPLES * channel_count) +
+      GAPCM_SECTOR_BLOCKS * GAPCM_SAMPLE_BYTES *
+          (f->header.length % GAPCM_BLOCK_SAMPLES);
+  FILE *cut = tmpfile();
+  size_t count_write = fwrite(f->stream, 1, cut_count, cut);
+  assert(count_write == cut_count);
+  gapcm_session_pipeline(session, false);
+  fseek(cut, GAPCM_SECTOR_BYTES, SEEK_SET);
+  fclose(output);
+  output = tmpfile();
+  size_t answer_cut =
+      gapcm_session_decode_stream(session, cut, output, GAMTEST_BUFFER_LOOPS);
+  uint8_t *frames = gamtest_file_read(output, answer_cut);
+  gapcm_session_pipeline(session, true);
+  fseek(cut, GAPCM_SECTOR_BYTES, SEEK_SET);
+  fclose(output);
+  output = tmpfile();
+  count =
+      gapcm_session_decode_stream(session, cut, output, GAMTEST_BUFFER_LOOPS);
+  printf("    cut:    %zu of %zu bytes" EOL, count, answer_cut);
+  assert(count == answer_cut);
+  // Loops from an odd stereo mark pair misaligned sectors and end early, at a
+  // short sector that the cut moves.
+  assert(f->header.mark % channel_count > 0 || count == f->answer_count);
+  gamtest_file_compare(output, 0, frames, count);
+  free(frames);
+  fclose(cut);
+  FILE *pcm = tmpfile();
+  count_write = fwrite(f->answer, 1, f->answer_count, pcm);
+  assert(count_write == f->answer_count);
+  rewind(pcm);
+  fclose(output);
+  output = tmpfile();
+  count = gapcm_session_encode_stream(session, pcm, output);
+  printf("    encode: %zu of %zu bytes" EOL, count, f->sectors_count);
+  assert(count == f->sectors_count);
+  gamtest_file_compare(output, 0, f->sectors, count);
+  session = gapcm_session_free(session);
+  free(memory.bytes);
+  free(answer_short);
+  fclose(pcm);
+  fclose(output);
+}
+
+void gamtest_parallel(const struct GamtestFixture *f) {
+  uint16_t channel_count = gapcm_to_channelcount(f->header.format);
+  struct GaPcmIoMemory source = {f->stream, f->stream_count, 0};
+  unsigned long long mark = GAPCM_BLOCK_BYTES * f->header.mark;
+  unsigned long long group = GAPCM_BLOCK_BYTES * channel_count;
+  struct GaPcmSegment segments[1 + GAMTEST_BUFFER_LOOPS];
+  segments[0] = (struct GaPcmSegment){GAPCM_SECTOR_BYTES, mark};
+  for (size_t index = 1; index <= GAMTEST_BUFFER_LOOPS; index++) {
+    segments[index] = (struct GaPcmSegment){
+        GAPCM_SECTOR_BYTES * (1ULL + f->header.mark),
+        GAPCM_SAMPLE_BYTES * f->header.length * channel_count - mark};
+  }
+  segments[1].position =
+      GAPCM_SECTOR_BYTES * (1 + (mark + group - 1) / group * channel_count);
+  struct GaPcmSession *session = gapcm_session_make(&f->header);
+  FILE *output = tmpfile();
+  size_t count = gapcm_session_decode_parallel(
+      session, &source, segments, 1 + GAMTEST_BUFFER_LOOPS, fileno(output),
+      GAPCM_SECTOR_BYTES, 3);
+  printf("    decode: %zu of %zu bytes" EOL, count, f->answer_count);
+  assert(count == f->answer_count);
+  gamtest_file_compare(output, GAPCM_SECTOR_BYTES, f->answer, count);
+  source.count = f->stream_count - GAPCM_SECTOR_BYTES;
+  uint8_t *answer_short;
+  size_t answer_short_count =
+      gamtest_fixture_short(f, source.count, f->answer_count, &answer_short);
+  fclose(output);
+  output = tmpfile();
+  count = gapcm_session_decode_parallel(session, &source, segments,
+                                        1 + GAMTEST_BUFFER_LOOPS,
+                                        fileno(output), 0, 0);
+  printf("    short:  %zu of %zu bytes" EOL, count, answer_short_count);
+  assert(count == answer_short_count);
+  gamtest_file_compare(output, 0, answer_short, count);
+  free(answer_short);
+  struct GaPcmIoMemory pcm = {f->answer, f->answer_count, 0};
+  fclose(output);
+  output = tmpfile();
+  count = gapcm_session_encode_parallel(session, &pcm, fileno(output), 0,
+                                        f->header.length, 3);
+  printf("    encode: %zu of %zu bytes" EOL, count, f->sectors_count);
+  assert(count == f->sectors_count);
+  gamtest_file_compare(output, 0, f->sectors, count);
+  session = gapcm_session_free(session);
+  fclose(output);
+}
+
 int main() {
   printf("Sample transcode for origin `0x%02x`." EOL, GAPCM_SAMPLE_ORIGIN);
   for (uint8_t sample = 0; sample < UINT8_MAX; sample++) {
@@ -139,6 +886,45 @@ int main() {
   sector[2] = 0x00;
   sector[3] = 0x7f;
   gamtest_sector(sector);
+  printf("Sector kernels for origin `0x%02x` and sample byte count of "
+         "`%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  gamtest_kernels();
+  printf("Buffer transcode for origin `0x%02x` and sample byte count of "
+         "`%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  gamtest_buffers(1);
+  gamtest_buffers(2);
+  printf("Pull decode for origin `0x%02x` and sample byte count of `%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  for (uint16_t channel_count = 1; channel_count <= 2; channel_count++) {
+    for (int loop_count = 0; loop_count <= 3; loop_count++) {
+      gamtest_decoder(channel_count, loop_count, false);
+      gamtest_decoder(channel_count, loop_count, true);
+    }
+  }
+  printf("I/O adapters for origin `0x%02x` and sample byte count of `%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  gamtest_io(1);
+  gamtest_io(2);
+  printf("Loop caches for origin `0x%02x` and sample byte count of `%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  gamtest_fixtures(gamtest_loops);
+  printf("Reads ahead for origin `0x%02x` and sample byte count of `%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  for (uint16_t channel_count = 1; channel_count <= 2; channel_count++) {
+    gamtest_prefetch(channel_count, false);
+    gamtest_prefetch(channel_count, true);
+  }
+  printf("Pipelines for origin `0x%02x` and sample byte count of `%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  gamtest_fixtures(gamtest_pipeline);
+#ifndef _WIN32
+  printf("Parallel transcodes for origin `0x%02x` and sample byte count of "
+         "`%u`." EOL,
+         GAPCM_SAMPLE_ORIGIN, GAPCM_SAMPLE_BYTES);
+  gamtest_fixtures(gamtest_parallel);
+#endif
   puts("Done.");
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,275 @@
+/**
+ * GAPCM Verifier
+ *
+ * Entry point to the verifier application. It consists of the main function
+ * from which the application initializes into an instance.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "apphelp.h"
+#include "appinfo.h"
+#include "common/application.h"
+#include "common/constants.h"
+#include "gam.h"
+#include "gapcm/io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <stdatomic.h>
+#endif
+
+/** Usage syntax. */
+#define GAMVERIFY_APPHELP_USAGE "Usage: [<option>]... <file>|<directory>..."
+/** Explanation to syntax. */
+#define GAMVERIFY_APPHELP_EXPLANATION                                          \
+  "\
+Options:\n\
+  -j, --threads <count>  Verify the given count of files at once. `0` for one\n\
+                         per processor. Default is `0`.\n\
+\n\
+Each given file, and each `.pcm` file in each given directory, is decoded\n\
+without pregap through its trail to memory, encoded again with the same\n\
+header fields, and compared by sector with itself. Mismatches are printed by\n\
+sector and byte offset. Samples of 0xff that come back as 0xfe are counted as\n\
+clamped instead, as the encoder clamps them.\n" APPHELP_EXPLANATION
+/** Application name. */
+#define GAMVERIFY_APPINFO_NAME APPINFO_NAME "verify"
+/** Application description. */
+#define GAMVERIFY_APPINFO_DESCRIPTION APPINFO_DESCRIPTION "verifier."
+
+/** Totals over all files. */
+#ifdef _WIN32
+static unsigned long long gamverify_counts[4];
+#else
+static atomic_ullong gamverify_counts[4];
+#endif
+/** Indices to totals. */
+enum GamVerifyCount { BYTES, CLAMPS, FILES, MISMATCHES };
+
+/** Adds the given count to the given total. */
+static void gamverify_count(const enum GamVerifyCount total,
+                            const unsigned long long count) {
+#ifdef _WIN32
+  gamverify_counts[total] += count;
+#else
+  atomic_fetch_add(&gamverify_counts[total], count);
+#endif
+}
+
+/**
+ * Compares the given encoded sectors of the given count with the given source
+ * of the given instance and returns the count of mismatches. Each is printed.
+ */
+static unsigned long long gamverify_compare(const struct GamInstance *i,
+                                            const struct GaPcmIoMemory *source,
+                                            const uint8_t *sectors,
+                                            const unsigned long long count) {
+  const uint8_t *bytes = source->bytes;
+  unsigned long long clamps = 0;
+  unsigned long long out = 0;
+  unsigned long long count_compare =
+      count < source->count ? count : source->count;
+  for (unsigned long long sector = 0;
+       sector * GAPCM_SECTOR_BYTES < count_compare; sector++) {
+    unsigned long long offset = sector * GAPCM_SECTOR_BYTES;
+    unsigned long long end = offset + GAPCM_SECTOR_BYTES < count_compare
+                                 ? offset + GAPCM_SECTOR_BYTES
+                                 : count_compare;
+    long long mismatch = -1;
+    for (; offset < end; offset++) {
+      if (sectors[offset] == bytes[offset]) {
+        continue;
+      }
+      // The header sector holds no samples.
+      if (sector > 0 &&
+          sectors[offset] ==
+              gapcm_encode_sample(gapcm_decode_sample(bytes[offset]))) {
+        clamps++;
+      } else if (mismatch < 0) {
+        mismatch = offset;
+      }
+    }
+    if (mismatch >= 0) {
+      char string[96];
+      snprintf(string, sizeof(string), "Sector %llu differs at byte %lld.",
+               sector, mismatch);
+      application_print_message(i->options->source, string);
+      out++;
+    }
+  }
+  if (count != source->count) {
+    char string[96];
+    snprintf(string, sizeof(string), "Encoded to %llu of %zu bytes.", count,
+             source->count);
+    application_print_message(i->options->source, string);
+    out++;
+  }
+  gamverify_count(CLAMPS, clamps);
+  return out;
+}
+
+/**
+ * Reads the source of the given instance whole to the given memory and returns
+ * its success. Its bytes are to be freed.
+ */
+static bool gamverify_read_whole(struct GamInstance *i,
+                                 struct GaPcmIoMemory *memory, int *success) {
+  long long count = -1;
+  if (fseeko(i->source, 0, SEEK_END) == SUCCESS) {
+    count = ftello(i->source);
+  }
+  if (count > 0 && fseeko(i->source, 0, SEEK_SET) == SUCCESS) {
+    memory->bytes = malloc(count);
+    memory->count = fread(memory->bytes, 1, count, i->source);
+  }
+  if (memory->bytes == NULL || memory->count != (unsigned long long)count) {
+    *success = EXIT_FAILURE;
+    application_print_message(i->options->source, GAM_ERROR_READ);
+    return false;
+  }
+  return true;
+}
+
+int gamverify_act(struct GamInstance *i) {
+  int out = EXIT_SUCCESS;
+  // Mapped where possible, read whole otherwise.
+  struct GaPcmIoMemory source = {NULL, 0, 0};
+  uint8_t *bytes = NULL;
+#ifndef _WIN32
+  if (gapcm_io_memory_map(i->map, fileno(i->source))) {
+    source = *i->map;
+  }
+#endif
+  if (source.bytes == NULL) {
+    if (!gamverify_read_whole(i, &source, &out)) {
+      free(source.bytes);
+      return out;
+    }
+    bytes = source.bytes;
+  }
+  // As the decoder with `-p 0 -l 1 -t`, then the encoder with `-t`.
+  struct GaPcmHeader header = *i->header;
+  header.pregap = 0;
+  struct GaPcmPlan plan;
+  unsigned long long count =
+      gapcm_decode_plan(&header, source.count, 1, true, &plan);
+  unsigned long long count_sectors =
+      GAPCM_SECTOR_BYTES * (1 + count / GAPCM_BLOCK_BYTES +
+                            gapcm_to_channelcount(header.format));
+  struct GaPcmIoMemory memories[] = {{malloc(count), count, 0},
+                                     {malloc(count_sectors), count_sectors,
+                                      GAPCM_SECTOR_BYTES}};
+  struct GaPcmIo ios[3];
+  source.position = GAPCM_SECTOR_BYTES;
+  i->session = gapcm_session_make(&header);
+  memories[0].count = gapcm_session_decode_io_for(
+      i->session, gapcm_io_memory(&ios[0], &source),
+      gapcm_io_memory(&ios[1], &memories[0]), UINT32_MAX);
+  memories[0].position = 0;
+  if (gapcm_encode_header(i->header, memories[1].bytes) !=
+      GAPCM_SECTOR_BYTES) {
+    out = gam_error_header(i->options->source);
+  } else {
+    count = GAPCM_SECTOR_BYTES +
+            gapcm_session_encode_io_for(i->session, &ios[1],
+                                        gapcm_io_memory(&ios[2], &memories[1]),
+                                        UINT32_MAX);
+    if (gamverify_compare(i, &source, memories[1].bytes, count) > 0) {
+      out = EXIT_FAILURE;
+      gamverify_count(MISMATCHES, 1);
+    }
+  }
+  gamverify_count(BYTES, source.count);
+  gamverify_count(FILES, 1);
+  free(memories[0].bytes);
+  free(memories[1].bytes);
+  free(bytes);
+  return out;
+}
+
+int gamverify_done(struct GamInstance *i) {
+  return application_file_close(i->source, i->options->source);
+}
+
+void gamverify_print_header(void) {
+  application_print_strings(
+      1, GAMVERIFY_APPINFO_NAME SPACE APPINFO_VER SPACE
+      "by Brendon" SPACE APPINFO_DATE "." EOL
+      "——" GAMVERIFY_APPINFO_DESCRIPTION SPACE APPINFO_URL EOL EOL);
+}
+
+int gamverify_help(void) {
+  gamverify_print_header();
+  application_print_strings(
+      1, GAMVERIFY_APPHELP_USAGE EOL GAMVERIFY_APPHELP_EXPLANATION EOL);
+  return GAM_EXIT_QUIT;
+}
+
+/** Prints the totals over the given duration in seconds. */
+void gamverify_print_totals(const double seconds) {
+  unsigned long long counts[4];
+  for (size_t index = 0; index < 4; index++) {
+    counts[index] = gamverify_counts[index];
+  }
+  printf("%llu file(s), %llu bytes in %.3f s: %.1f MiB/s. %llu mismatched, "
+         "%llu sample(s) clamped." EOL,
+         counts[FILES], counts[BYTES], seconds,
+         seconds > 0 ? counts[BYTES] / seconds / (1024 * 1024) : 0.0,
+         counts[MISMATCHES], counts[CLAMPS]);
+}
+
+int gamverify_read(struct GamInstance *i) {
+  int out;
+  if (!gam_open_source(i->options->source, &i->source, &out)) {
+    return out;
+  }
+  uint8_t *sector = malloc(GAPCM_SECTOR_BYTES);
+  const char *error = NULL;
+  i->read_count += fread(sector, 1, GAPCM_SECTOR_BYTES, i->source);
+  if (i->read_count != GAPCM_SECTOR_BYTES ||
+      gapcm_decode_header(sector, i->header) != GAPCM_SECTOR_BYTES) {
+    out = gam_error_header(i->options->source);
+  } else if (!gapcm_header_check(i->header, &error)) {
+    out = EXIT_FAILURE;
+    application_print_message(i->options->source, error);
+  }
+  free(sector);
+  return out;
+}
+
+#define GAMVERIFY_OPTION_COUNT 1
+/** The main method is the entry point to this application. */
+int main(int argument_count, char *arguments[]) {
+  if (argument_count < 2) {
+    gamverify_print_header();
+    application_print_strings(
+        1, GAMVERIFY_APPHELP_USAGE EOL APPHELP_INVITATION EOL);
+    return EXIT_SUCCESS;
+  }
+  struct GamInstance *instance = gam_instance_make(arguments, argument_count);
+  instance->extension = ".pcm";
+  instance->name = GAMVERIFY_APPINFO_NAME;
+  instance->options->has_batch = true;
+  struct GamOption **options =
+      malloc(sizeof(options) * GAMVERIFY_OPTION_COUNT);
+  options[0] = gam_option_make("-j", "--threads", gam_parse_threads);
+  struct timespec times[2];
+  timespec_get(&times[0], TIME_UTC);
+  int out = gam_run(instance, options, GAMVERIFY_OPTION_COUNT, gamverify_help,
+                    gamverify_read, gamverify_act, gamverify_done);
+  timespec_get(&times[1], TIME_UTC);
+  if (instance->options->sources != NULL) {
+    gamverify_print_totals((double)(times[1].tv_sec - times[0].tv_sec) +
+                           (times[1].tv_nsec - times[0].tv_nsec) / 1e9);
+  }
+  instance = gam_instance_free(instance);
+  for (size_t index = 0; index < GAMVERIFY_OPTION_COUNT; index++) {
+    options[index] = gam_option_free(options[index]);
+  }
+  free(options);
+  return out;
+}
+#undef GAMVERIFY_OPTION_COUNT
@@ -1,14 +1,11 @@
 // File operators stop on I/O anomalies. Echo, fade, and gain features are not
 // supported; get their parameters here and apply them elsewhere.
 
-/**
- * Undo setting of `errno` to `EBADF` on `fflush`. Flushing input streams is
- * undefined on older POSIX systems where `EBADF` may be set. This is defined by
- * default for compatibility and should be undefined for debugging.
- */
-#define GAPCM_FFLUSH_EBADF
+#define _POSIX_C_SOURCE 200809L
 
 #include "gapcm.h"
+#include "simd.h"
+#include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,170 +14,1533 @@
 #include <winsock2.h>
 #else
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 #define GAPCM_SUCCESS 0
+/** Silence buffer size in blocks. */
+#define GAPCM_SILENCE_BLOCKS 16
+/** Silence buffer size in bytes. */
+#define GAPCM_SILENCE_BYTES (GAPCM_BLOCK_BYTES * GAPCM_SILENCE_BLOCKS)
+
+/**
+ * Count of bytes read ahead at the mark, and of bytes before the loop end from
+ * which it is.
+ */
+#define GAPCM_LOOP_PREFETCH_BYTES (64 * GAPCM_SECTOR_BYTES)
+
+/** Session buffer alignment in bytes. */
+#define GAPCM_SESSION_ALIGNMENT 64
+
+/** Count of times a pipeline thread yields before it sleeps. */
+#define GAPCM_PIPELINE_SPINS 64
+/** Pipeline ring slot count. */
+#define GAPCM_PIPELINE_SLOTS 32
+/** Pipeline ring slot size in bytes: a sector or a block of stereo frames. */
+#define GAPCM_PIPELINE_SLOT_BYTES                                              \
+  (GAPCM_SECTOR_BYTES > 2 * GAPCM_BLOCK_BYTES ? GAPCM_SECTOR_BYTES             \
+                                               : 2 * GAPCM_BLOCK_BYTES)
 
-/** Represents a transcoding context. */
-struct GaPcmIoContext {
+/** Parallel decode job size in groups of a sector for each channel. */
+#define GAPCM_PARALLEL_GROUPS 64
+
+/** Transcodes that sessions run. */
+enum GaPcmSessionRun {
+  /** Stream decode for a count of loops. */
+  GAPCM_RUN_DECODE,
+  /** Decode for a count of samples. */
+  GAPCM_RUN_DECODE_FOR,
+  /** Loop decode for a count of loops. */
+  GAPCM_RUN_DECODE_LOOP,
+  /** Encode for a count of samples. */
+  GAPCM_RUN_ENCODE_FOR
+};
+
+/** Represents a transcoding session. */
+struct GaPcmSession {
   /** GAPCM header. */
   const struct GaPcmHeader *header;
   /** Output stream. */
-  FILE *output;
+  const struct GaPcmIo *output;
   /** Source stream. */
-  FILE *source;
+  const struct GaPcmIo *source;
   /** Block byte counts. */
-  size_t *counts;
-  /** Block indexes. */
-  size_t *indexes;
+  size_t counts[2];
   /** Consumer PCM buffers. */
   uint8_t *blocks;
+  /** Interleaved consumer PCM buffer. */
+  uint8_t *frames;
   /** GAPCM sector buffer. */
   uint8_t *sector;
+  /** Owned memory. NULL if caller-owned. */
+  void *memory;
+  /** Loop cache capacity in memory in bytes. `0` for no cache. */
+  size_t cache;
   /** Stream channel count. */
   uint16_t CHANNEL_COUNT;
+  /** Maximum stream channel count. */
+  uint16_t CHANNEL_CAPACITY;
+  /** Run transcodes in a pipeline? */
+  bool pipeline;
+};
+
+static_assert(GAPCM_SESSION_ALIGNMENT - 1 +
+                      (sizeof(struct GaPcmSession) +
+                       GAPCM_SESSION_ALIGNMENT - 1) /
+                          GAPCM_SESSION_ALIGNMENT * GAPCM_SESSION_ALIGNMENT <=
+                  GAPCM_SESSION_BYTES - GAPCM_SECTOR_BYTES -
+                      4 * GAPCM_BLOCK_BYTES,
+              "GAPCM_SESSION_BYTES is too small.");
+
+/**
+ * Represents a loop cache: the decoded frames of one loop, captured as they are
+ * written so that following loops replay them.
+ */
+struct GaPcmLoopCache {
+  /** Output stream. */
+  const struct GaPcmIo *output;
+  /** Capturing stream. */
+  struct GaPcmIo io;
+  /** Frames. NULL if unavailable. */
+  uint8_t *bytes;
+  /** Spill file. NULL if in memory. */
+  FILE *file;
+  /** Count of bytes captured. */
+  size_t count;
+  /** Capacity in bytes. */
+  size_t capacity;
+};
+
+/** Represents a pull decoder. */
+struct GaPcmDecoder {
+  /** Transcoding session. */
+  struct GaPcmSession *session;
+  /** Source stream. */
+  struct GaPcmIo source;
+  /** Decoded frames. */
+  const uint8_t *frames;
+  /** Count of bytes left in the phase. */
+  unsigned long long count;
+  /** Count of bytes in the decoded frames. */
+  size_t frames_count;
+  /** Index to the next decoded frame byte. */
+  size_t frames_index;
+  /** Count of loops left to start. */
+  int loop_count;
+  /** Count of loops to start from the pregap. */
+  int loops;
+  /** Current phase. */
+  enum GaPcmDecoderPhase phase;
+  /** Include trailing samples? */
+  bool trail;
+  /** Source ended or failed? */
+  bool end;
+};
+
+const unsigned char gapcm_origin[] = {0x7f, 0x80};
+const unsigned char gapcm_sample_origin[] = {0, GAPCM_SAMPLE_ORIGIN};
+
+/** Consumer PCM origin samples. */
+static uint8_t gapcm_silence[GAPCM_SILENCE_BYTES];
+
+/** Fills the silence buffer. */
+__attribute__((constructor)) static void gapcm_silence_make(void) {
+  for (size_t index = 0; index < GAPCM_SILENCE_BYTES;
+       index += GAPCM_SAMPLE_BYTES) {
+    memcpy(&gapcm_silence[index], &gapcm_sample_origin[GAPCM_SAMPLE_BYTES_PAD],
+           GAPCM_SAMPLE_BYTES);
+  }
+}
+
+/** Reads to the given location from the given stream. See `GaPcmIo`. */
+static size_t gapcm_io_read(const struct GaPcmIo *io, void *restrict bytes,
+                            const size_t count) {
+  return io->READ(io->user, bytes, count);
+}
+
+/** Writes from the given location to the given stream. See `GaPcmIo`. */
+static size_t gapcm_io_write(const struct GaPcmIo *io,
+                             const void *restrict bytes, const size_t count) {
+  return io->WRITE(io->user, bytes, count);
+}
+
+/**
+ * Hints the given source to read ahead at the mark of the given header, so that
+ * seeking there at the end of a loop does not wait on the read.
+ */
+static void gapcm_decode_prefetch(const struct GaPcmIo *source,
+                                  const struct GaPcmHeader *header) {
+  if (source->PREFETCH != NULL) {
+    source->PREFETCH(source->user, GAPCM_SECTOR_BYTES * (1ULL + header->mark),
+                     GAPCM_LOOP_PREFETCH_BYTES);
+  }
+}
+
+/**
+ * Returns the count of bytes of a loop of the given count of samples in the
+ * given stream to decode before reading ahead at the mark: whole groups up to
+ * `GAPCM_LOOP_PREFETCH_BYTES` before the loop end.
+ */
+static unsigned long long gapcm_decode_ahead(const uint16_t channel_count,
+                                             const unsigned long long count) {
+  unsigned long long group = GAPCM_BLOCK_BYTES * channel_count;
+  return count > GAPCM_LOOP_PREFETCH_BYTES
+             ? (count - GAPCM_LOOP_PREFETCH_BYTES) / group * group
+             : 0;
+}
+
+/**
+ * Seeks the source of the given context to its mark and returns its success.
+ */
+static int gapcm_decode_context_seek(const struct GaPcmSession *c) {
+  return c->source->SEEK(c->source->user,
+                         GAPCM_SECTOR_BYTES * (1ULL + c->header->mark));
+}
+
+/**
+ * Returns the count of interleaved bytes of the decoded blocks of the given
+ * context.
+ */
+static size_t gapcm_decode_context_count(const struct GaPcmSession *c) {
+  return c->CHANNEL_COUNT * ((c->counts[0] + GAPCM_SAMPLE_BYTES - 1) /
+                             GAPCM_SAMPLE_BYTES * GAPCM_SAMPLE_BYTES);
+}
+
+/**
+ * Interleaves the decoded blocks of the given context to the given location. A
+ * channel shorter than the first is filled with origin samples.
+ */
+static void gapcm_decode_context_interleave(const struct GaPcmSession *c,
+                                            uint8_t *restrict frames) {
+  size_t count = gapcm_decode_context_count(c) / c->CHANNEL_COUNT;
+  if (c->CHANNEL_COUNT == 1) {
+    memcpy(frames, c->blocks, count);
+    return;
+  }
+  size_t index = (c->counts[1] + GAPCM_SAMPLE_BYTES - 1) / GAPCM_SAMPLE_BYTES *
+                 GAPCM_SAMPLE_BYTES;
+  if (index > count) {
+    index = count;
+  }
+  const struct GaPcmSimdKernel *kernel = gapcm_simd_kernel();
+  kernel->INTERLEAVE(c->blocks, &c->blocks[GAPCM_BLOCK_BYTES], index, frames);
+  kernel->INTERLEAVE(&c->blocks[index], gapcm_silence, count - index,
+                     &frames[2 * index]);
+}
+
+/**
+ * Decodes the given sector of the given count of bytes to the block of the
+ * given channel of the given context and returns whether it was whole. The
+ * block byte count is capped to that of each channel in the given count of
+ * samples, and those of the following channels are cleared.
+ */
+static bool gapcm_decode_context_sector(struct GaPcmSession *c,
+                                        const size_t channel,
+                                        const uint8_t *restrict sector,
+                                        const size_t count_sector,
+                                        const unsigned long long count) {
+  c->counts[channel] = gapcm_decode_sector(
+      sector, count_sector, &c->blocks[GAPCM_BLOCK_BYTES * channel]);
+  bool out = c->counts[channel] == GAPCM_BLOCK_BYTES;
+  if (c->counts[channel] > count / c->CHANNEL_COUNT) {
+    c->counts[channel] = count / c->CHANNEL_COUNT;
+  }
+  for (size_t index = channel + 1; !out && index < c->CHANNEL_COUNT; index++) {
+    c->counts[index] = 0;
+  }
+  return out;
+}
+
+/**
+ * Decodes the next sector from the source of the given context like
+ * `gapcm_decode_context_sector` and returns whether it was whole. Sectors of a
+ * memory source are decoded in place.
+ */
+static bool gapcm_decode_context_next(struct GaPcmSession *c,
+                                      const size_t channel,
+                                      const unsigned long long count) {
+  struct GaPcmIoMemory *m = gapcm_io_memory_of(c->source);
+  if (m == NULL) {
+    return gapcm_decode_context_sector(
+        c, channel, c->sector,
+        gapcm_io_read(c->source, c->sector, GAPCM_SECTOR_BYTES), count);
+  }
+  size_t count_sector = m->count - m->position < GAPCM_SECTOR_BYTES
+                            ? m->count - m->position
+                            : GAPCM_SECTOR_BYTES;
+  const uint8_t *sector = &m->bytes[m->position];
+  m->position += count_sector;
+  return gapcm_decode_context_sector(c, channel, sector, count_sector, count);
+}
+
+/** Runs the given decode context for the given count of samples. */
+static unsigned long long gapcm_decode_context_for(struct GaPcmSession *c,
+                                                   unsigned long long count) {
+  if (c->CHANNEL_COUNT <= 0) {
+    return 0;
+  }
+  unsigned long long out = 0;
+  bool error = false;
+  while (!error && count >= c->CHANNEL_COUNT) {
+    for (size_t channel = 0; !error && channel < c->CHANNEL_COUNT; channel++) {
+      error = !gapcm_decode_context_next(c, channel, count);
+    }
+    const uint8_t *frames = c->blocks;
+    if (c->CHANNEL_COUNT > 1) {
+      gapcm_decode_context_interleave(c, c->frames);
+      frames = c->frames;
+    }
+    size_t count_frames = gapcm_decode_context_count(c);
+    size_t count_write = gapcm_io_write(c->output, frames, count_frames);
+    out += count_write;
+    if (count_write != count_frames) {
+      return out;
+    }
+    count -= c->counts[0] * c->CHANNEL_COUNT;
+  }
+  return out;
+}
+
+/**
+ * Runs the given decode context for the given count of samples of a loop. If
+ * another follows, the source is hinted at the mark near the loop end.
+ */
+static unsigned long long
+gapcm_decode_context_for_loop(struct GaPcmSession *c, unsigned long long count,
+                              const bool looping) {
+  unsigned long long count_ahead =
+      looping ? gapcm_decode_ahead(c->CHANNEL_COUNT, count) : count;
+  unsigned long long out = gapcm_decode_context_for(c, count_ahead);
+  if (!looping || out != count_ahead) {
+    return out;
+  }
+  gapcm_decode_prefetch(c->source, c->header);
+  return out + gapcm_decode_context_for(c, count - count_ahead);
+}
+
+/**
+ * Runs the given decode context from the given buffers for the given count of
+ * samples. Sectors of all channels are taken at once, and only while their
+ * frames fit in the output.
+ */
+static unsigned long long
+gapcm_decode_context_buffer(struct GaPcmSession *c, struct GaPcmBuffers *b,
+                            unsigned long long count) {
+  if (c->CHANNEL_COUNT <= 0) {
+    return 0;
+  }
+  unsigned long long out = 0;
+  bool error = false;
+  while (!error && count >= c->CHANNEL_COUNT) {
+    size_t count_source = GAPCM_SECTOR_BYTES * c->CHANNEL_COUNT;
+    if (b->source_count < count_source) {
+      if (!b->source_end) {
+        break;
+      }
+      count_source = b->source_count;
+    }
+    for (size_t channel = 0; !error && channel < c->CHANNEL_COUNT; channel++) {
+      size_t index = GAPCM_SECTOR_BYTES * channel;
+      size_t count_sector = count_source - index < GAPCM_SECTOR_BYTES
+                                ? count_source - index
+                                : GAPCM_SECTOR_BYTES;
+      error = !gapcm_decode_context_sector(c, channel, &b->source[index],
+                                           count_sector, count);
+    }
+    size_t count_frames = gapcm_decode_context_count(c);
+    if (count_frames > b->output_count) {
+      break;
+    }
+    gapcm_decode_context_interleave(c, b->output);
+    b->output += count_frames;
+    b->output_count -= count_frames;
+    b->source += count_source;
+    b->source_count -= count_source;
+    out += count_frames;
+    count -= c->counts[0] * c->CHANNEL_COUNT;
+  }
+  return out;
+}
+
+/** Returns the count of bytes in a loop of the given decode context. */
+static unsigned long long
+gapcm_decode_context_length(const struct GaPcmSession *c) {
+  return GAPCM_SAMPLE_BYTES * c->header->length * c->CHANNEL_COUNT -
+         GAPCM_BLOCK_BYTES * c->header->mark;
+}
+
+/** Writes to the output of the given loop cache and captures what was. */
+static size_t gapcm_loop_cache_write(void *user, const void *bytes,
+                                     const size_t count) {
+  struct GaPcmLoopCache *cache = user;
+  size_t out = gapcm_io_write(cache->output, bytes, count);
+  size_t count_copy = cache->capacity - cache->count < out
+                          ? cache->capacity - cache->count
+                          : out;
+  memcpy(&cache->bytes[cache->count], bytes, count_copy);
+  cache->count += count_copy;
+  return out;
+}
+
+/**
+ * Frees the frames of the given loop cache. Its bytes are NULL afterwards.
+ */
+static void gapcm_loop_cache_close(struct GaPcmLoopCache *cache) {
+  if (cache->file == NULL) {
+    free(cache->bytes);
+  } else {
+#ifndef _WIN32
+    munmap(cache->bytes, cache->capacity);
+#endif
+    fclose(cache->file);
+    cache->file = NULL;
+  }
+  cache->bytes = NULL;
+}
+
+/**
+ * Allocates the given loop cache for the given count of bytes, in memory up to
+ * the given capacity and in a mapped temporary file beyond, and returns its
+ * success.
+ */
+static bool gapcm_loop_cache_open(struct GaPcmLoopCache *cache,
+                                  const unsigned long long count,
+                                  const size_t capacity) {
+  cache->io = (struct GaPcmIo){.WRITE = gapcm_loop_cache_write, .user = cache};
+  cache->count = 0;
+  cache->capacity = count;
+  if (count <= 0 || count > SIZE_MAX) {
+    return false;
+  }
+  if (count <= capacity) {
+    cache->bytes = malloc(count);
+    return cache->bytes != NULL;
+  }
+#ifndef _WIN32
+  cache->file = tmpfile();
+  if (cache->file != NULL && ftruncate(fileno(cache->file), count) == 0) {
+    void *bytes = mmap(NULL, count, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fileno(cache->file), 0);
+    if (bytes != MAP_FAILED) {
+      cache->bytes = bytes;
+      return true;
+    }
+  }
+  if (cache->file != NULL) {
+    fclose(cache->file);
+    cache->file = NULL;
+  }
+#endif
+  return false;
+}
+
+/**
+ * Runs the given decode context for the given count of loops,
+ * `GAPCM_LOOP_FOREVER` for until the output fails. With a loop cache, the
+ * first loop from the mark is captured to it if the source can tell its
+ * position, and following loops replay it without reading or seeking. The
+ * source is left where the last loop would have left it.
+ */
+static unsigned long long gapcm_decode_context_loop(struct GaPcmSession *c,
+                                                    int loop_count) {
+  if (loop_count < 1 && loop_count != GAPCM_LOOP_FOREVER) {
+    return 0;
+  }
+  unsigned long long length_loop = gapcm_decode_context_length(c);
+  struct GaPcmLoopCache cache = {.output = c->output};
+  long long position = -1;
+  bool replayed = false;
+  unsigned long long out = 0;
+  while (true) {
+    unsigned long long count_decode;
+    if (position >= 0) {
+      count_decode = gapcm_io_write(c->output, cache.bytes, cache.count);
+      replayed = true;
+    } else if (cache.bytes != NULL) {
+      c->output = &cache.io;
+      count_decode = gapcm_decode_context_for(c, length_loop);
+      c->output = cache.output;
+      if (cache.count == length_loop) {
+        position = c->source->TELL(c->source->user);
+      }
+    } else {
+      count_decode = gapcm_decode_context_for_loop(
+          c, length_loop, loop_count == GAPCM_LOOP_FOREVER || loop_count > 1);
+    }
+    out += count_decode;
+    if (count_decode != length_loop ||
+        (loop_count != GAPCM_LOOP_FOREVER && --loop_count < 1)) {
+      break;
+    }
+    if (position < 0) {
+      if (gapcm_decode_context_seek(c) != GAPCM_SUCCESS) {
+        break;
+      }
+      if (cache.bytes == NULL && c->cache > 0 && c->source->TELL != NULL &&
+          (loop_count > 1 || loop_count == GAPCM_LOOP_FOREVER)) {
+        gapcm_loop_cache_open(&cache, length_loop, c->cache);
+      }
+    }
+  }
+  if (replayed) {
+    c->source->SEEK(c->source->user, position);
+  }
+  if (cache.bytes != NULL) {
+    gapcm_loop_cache_close(&cache);
+  }
+  return out;
+}
+
+/**
+ * Runs the given decode context from the given buffers for the given count of
+ * loops. Each loop restarts from the source position at the call.
+ */
+static unsigned long long
+gapcm_decode_context_buffer_loop(struct GaPcmSession *c, struct GaPcmBuffers *b,
+                                 int loop_count) {
+  if (loop_count < 1 && loop_count != GAPCM_LOOP_FOREVER) {
+    return 0;
+  }
+  const uint8_t *mark = b->source;
+  size_t mark_count = b->source_count;
+  unsigned long long length_loop = gapcm_decode_context_length(c);
+  unsigned long long out = 0;
+  while (true) {
+    unsigned long long count_decode =
+        gapcm_decode_context_buffer(c, b, length_loop);
+    out += count_decode;
+    if (count_decode != length_loop ||
+        (loop_count != GAPCM_LOOP_FOREVER && --loop_count < 1)) {
+      break;
+    }
+    b->source = mark;
+    b->source_count = mark_count;
+  }
+  return out;
+}
+
+/**
+ * Splits the given count of bytes of consumer PCM frames to the blocks of the
+ * given context. Channel byte counts stop at the last whole sample.
+ */
+static void gapcm_encode_context_split(struct GaPcmSession *c,
+                                       const uint8_t *restrict frames,
+                                       const size_t count) {
+  size_t count_samples = count / GAPCM_SAMPLE_BYTES;
+  for (size_t channel = 0; channel < c->CHANNEL_COUNT; channel++) {
+    c->counts[channel] =
+        GAPCM_SAMPLE_BYTES * (count_samples / c->CHANNEL_COUNT +
+                              (channel < count_samples % c->CHANNEL_COUNT));
+  }
+  if (c->CHANNEL_COUNT == 1) {
+    if (frames != c->blocks) {
+      memcpy(c->blocks, frames, c->counts[0]);
+    }
+    return;
+  }
+  gapcm_simd_kernel()->DEINTERLEAVE(frames, c->counts[1], c->blocks,
+                                    &c->blocks[GAPCM_BLOCK_BYTES]);
+  if (c->counts[0] > c->counts[1]) {
+    memcpy(&c->blocks[c->counts[1]], &frames[2 * c->counts[1]],
+           GAPCM_SAMPLE_BYTES);
+  }
+}
+
+/**
+ * Reads consumer PCM for the given count of bytes per channel to the blocks of
+ * the given context and returns its success.
+ */
+static bool gapcm_encode_context_read(struct GaPcmSession *c,
+                                      const size_t count) {
+  uint8_t *frames = c->CHANNEL_COUNT == 1 ? c->blocks : c->frames;
+  size_t count_read =
+      gapcm_io_read(c->source, frames, c->CHANNEL_COUNT * count);
+  gapcm_encode_context_split(c, frames, count_read);
+  return count_read == c->CHANNEL_COUNT * count;
+}
+
+/**
+ * Returns the count of bytes per channel to read next by the given encode
+ * context for the given count of samples. Whole samples are read for each
+ * channel.
+ */
+static size_t gapcm_encode_context_block(const struct GaPcmSession *c,
+                                         const unsigned long long count) {
+  size_t out = count / c->CHANNEL_COUNT > GAPCM_BLOCK_BYTES
+                   ? GAPCM_BLOCK_BYTES
+                   : count / c->CHANNEL_COUNT;
+  return (out + GAPCM_SAMPLE_BYTES - 1) / GAPCM_SAMPLE_BYTES *
+         GAPCM_SAMPLE_BYTES;
+}
+
+/**
+ * Pads the block of the given channel of the given context with origin samples
+ * and encodes it to the given sector.
+ */
+static size_t gapcm_encode_context_sector(struct GaPcmSession *c,
+                                          const size_t channel,
+                                          uint8_t *restrict sector) {
+  for (size_t index = c->counts[channel]; index < GAPCM_BLOCK_BYTES;
+       index += GAPCM_SAMPLE_BYTES) {
+    memcpy(&c->blocks[GAPCM_BLOCK_BYTES * channel + index],
+           &gapcm_sample_origin[GAPCM_SAMPLE_BYTES_PAD], GAPCM_SAMPLE_BYTES);
+  }
+  return gapcm_encode_sector(&c->blocks[GAPCM_BLOCK_BYTES * channel],
+                             GAPCM_BLOCK_BYTES, sector);
+}
+
+/** Runs the given encode context for the given count of samples. */
+static unsigned long long gapcm_encode_context_for(struct GaPcmSession *c,
+                                                   unsigned long long count) {
+  if (c->CHANNEL_COUNT <= 0) {
+    return 0;
+  }
+  unsigned long long out = 0;
+  bool error = false;
+  while (!error && count >= c->CHANNEL_COUNT) {
+    error = !gapcm_encode_context_read(c, gapcm_encode_context_block(c, count));
+    for (size_t channel = 0;
+         channel < c->CHANNEL_COUNT && c->counts[channel] > 0; channel++) {
+      count -= c->counts[channel];
+      unsigned long count_write = gapcm_io_write(
+          c->output, c->sector,
+          gapcm_encode_context_sector(c, channel, c->sector));
+      out += count_write;
+      if (count_write / GAPCM_SECTOR_BLOCKS != GAPCM_BLOCK_BYTES) {
+        return out;
+      }
+    }
+  }
+  return out;
+}
+
+/**
+ * Runs the given encode context from the given buffers for the given count of
+ * samples. Frames are taken a block at a time, and only while their sectors fit
+ * in the output.
+ */
+static unsigned long long
+gapcm_encode_context_buffer(struct GaPcmSession *c, struct GaPcmBuffers *b,
+                            unsigned long long count) {
+  if (c->CHANNEL_COUNT <= 0) {
+    return 0;
+  }
+  unsigned long long out = 0;
+  bool error = false;
+  while (!error && count >= c->CHANNEL_COUNT) {
+    size_t count_source =
+        c->CHANNEL_COUNT * gapcm_encode_context_block(c, count);
+    if (b->source_count < count_source) {
+      if (!b->source_end) {
+        break;
+      }
+      count_source = b->source_count;
+      error = true;
+    }
+    gapcm_encode_context_split(c, b->source, count_source);
+    size_t channel_count = 0;
+    while (channel_count < c->CHANNEL_COUNT && c->counts[channel_count] > 0) {
+      channel_count++;
+    }
+    if (GAPCM_SECTOR_BYTES * channel_count > b->output_count) {
+      break;
+    }
+    b->source += count_source;
+    b->source_count -= count_source;
+    for (size_t channel = 0; channel < channel_count; channel++) {
+      count -= c->counts[channel];
+      gapcm_encode_context_sector(c, channel, b->output);
+      b->output += GAPCM_SECTOR_BYTES;
+      b->output_count -= GAPCM_SECTOR_BYTES;
+      out += GAPCM_SECTOR_BYTES;
+    }
+  }
+  return out;
+}
+
+/** Rounds the given address up to the session buffer alignment. */
+static uint8_t *gapcm_session_align(uint8_t *address) {
+  return address + (GAPCM_SESSION_ALIGNMENT -
+                    (uintptr_t)address % GAPCM_SESSION_ALIGNMENT) %
+                       GAPCM_SESSION_ALIGNMENT;
+}
+
+/** Binds the given streams to the given session and returns the session. */
+static struct GaPcmSession *gapcm_session_open(struct GaPcmSession *s,
+                                               const struct GaPcmIo *source,
+                                               const struct GaPcmIo *output) {
+  s->output = output;
+  s->source = source;
+  return s;
+}
+
+/**
+ * Runs the given transcode on the given context for the given count of samples
+ * or loops. The stream decode takes its count from the mark.
+ */
+static unsigned long long
+gapcm_session_run_serial(struct GaPcmSession *c, const enum GaPcmSessionRun run,
+                         const unsigned long long count, const int loop_count) {
+  switch (run) {
+  case GAPCM_RUN_DECODE: {
+    unsigned long long mark = GAPCM_BLOCK_BYTES * c->header->mark;
+    unsigned long long out = gapcm_decode_context_for(c, mark);
+    if (out == mark) {
+      out += gapcm_decode_context_loop(c, loop_count);
+    }
+    return out;
+  }
+  case GAPCM_RUN_DECODE_FOR:
+    return gapcm_decode_context_for(c, count);
+  case GAPCM_RUN_DECODE_LOOP:
+    return gapcm_decode_context_loop(c, loop_count);
+  case GAPCM_RUN_ENCODE_FOR:
+    return gapcm_encode_context_for(c, count);
+  }
+  return 0;
+}
+
+#ifndef _WIN32
+/** Represents a pipeline ring slot. */
+struct GaPcmPipelineSlot {
+  /** Count of bytes. */
+  size_t count;
+  /** Seek status. */
+  int status;
+  /** Seek `errno`. */
+  int error;
+  /** Seek instead of bytes? */
+  bool seek;
+  /** Bytes. */
+  uint8_t bytes[GAPCM_PIPELINE_SLOT_BYTES];
 };
 
-const unsigned char gapcm_origin[] = {0x7f, 0x80};
-const unsigned char gapcm_sample_origin[] = {0, GAPCM_SAMPLE_ORIGIN};
+/**
+ * Represents a bounded single-producer, single-consumer ring of pipeline slots.
+ * Each side owns its index and only reads that of the other.
+ */
+struct GaPcmPipelineRing {
+  /** Slots. */
+  struct GaPcmPipelineSlot slots[GAPCM_PIPELINE_SLOTS];
+  /** Count of slots popped. */
+  atomic_size_t head;
+  /** Count of slots pushed. */
+  atomic_size_t tail;
+  /** No more slots will be pushed? */
+  atomic_bool closed;
+  /** No more slots will be popped? */
+  atomic_bool cancelled;
+};
+
+/**
+ * Represents a pipeline of a reader thread, the calling thread transcoding, and
+ * a writer thread. The reader follows the reads and seeks of the transcode in
+ * advance, so the transcode runs unchanged on rings in their place.
+ */
+struct GaPcmPipeline {
+  /** Source and output rings. */
+  struct GaPcmPipelineRing rings[2];
+  /** Ring adapters to the source and output rings. */
+  struct GaPcmIo ios[2];
+  /** Transcoding session. */
+  struct GaPcmSession *session;
+  /** Output stream. */
+  const struct GaPcmIo *output;
+  /** Source stream. */
+  const struct GaPcmIo *source;
+  /** Mutex to wait with. */
+  pthread_mutex_t mutex;
+  /** Condition to wait on. */
+  pthread_cond_t condition;
+  /** Count of waiting threads. */
+  atomic_int waiters;
+  /** Write failed? Following slots are dropped. */
+  atomic_bool failed;
+  /** Count of bytes written. */
+  unsigned long long write_count;
+  /** Count of samples or loops. */
+  unsigned long long count;
+  /** `errno` of the reader and writer on failure. */
+  int errors[2];
+  /** Count of loops. */
+  int loop_count;
+  /** Transcode. */
+  enum GaPcmSessionRun run;
+};
+
+/** Wakes the threads waiting on the given pipeline. */
+static void gapcm_pipeline_wake(struct GaPcmPipeline *p) {
+  if (atomic_load(&p->waiters) > 0) {
+    pthread_mutex_lock(&p->mutex);
+    pthread_cond_broadcast(&p->condition);
+    pthread_mutex_unlock(&p->mutex);
+  }
+}
+
+/**
+ * Returns the next slot to pop from the given ring of the given pipeline,
+ * waiting for one, or NULL once the ring is closed and empty.
+ */
+static struct GaPcmPipelineSlot *
+gapcm_pipeline_front(struct GaPcmPipeline *p, struct GaPcmPipelineRing *r) {
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  struct GaPcmPipelineSlot *out = NULL;
+  size_t spin_count = 0;
+  bool waiting = false;
+  while (true) {
+    bool closed = atomic_load(&r->closed);
+    if (atomic_load(&r->tail) != head) {
+      out = &r->slots[head % GAPCM_PIPELINE_SLOTS];
+      break;
+    }
+    if (closed) {
+      break;
+    }
+    if (waiting) {
+      pthread_cond_wait(&p->condition, &p->mutex);
+    } else if (spin_count++ < GAPCM_PIPELINE_SPINS) {
+      sched_yield();
+    } else {
+      atomic_fetch_add(&p->waiters, 1);
+      pthread_mutex_lock(&p->mutex);
+      waiting = true;
+    }
+  }
+  if (waiting) {
+    pthread_mutex_unlock(&p->mutex);
+    atomic_fetch_sub(&p->waiters, 1);
+  }
+  return out;
+}
+
+/**
+ * Returns the next slot to push to the given ring of the given pipeline,
+ * waiting for one, or NULL once the ring is cancelled.
+ */
+static struct GaPcmPipelineSlot *
+gapcm_pipeline_back(struct GaPcmPipeline *p, struct GaPcmPipelineRing *r) {
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  struct GaPcmPipelineSlot *out = NULL;
+  size_t spin_count = 0;
+  bool waiting = false;
+  while (!atomic_load(&r->cancelled)) {
+    if (tail - atomic_load(&r->head) < GAPCM_PIPELINE_SLOTS) {
+      out = &r->slots[tail % GAPCM_PIPELINE_SLOTS];
+      break;
+    }
+    if (waiting) {
+      pthread_cond_wait(&p->condition, &p->mutex);
+    } else if (spin_count++ < GAPCM_PIPELINE_SPINS) {
+      sched_yield();
+    } else {
+      atomic_fetch_add(&p->waiters, 1);
+      pthread_mutex_lock(&p->mutex);
+      waiting = true;
+    }
+  }
+  if (waiting) {
+    pthread_mutex_unlock(&p->mutex);
+    atomic_fetch_sub(&p->waiters, 1);
+  }
+  return out;
+}
+
+/** Pops the front slot of the given ring of the given pipeline. */
+static void gapcm_pipeline_pop(struct GaPcmPipeline *p,
+                               struct GaPcmPipelineRing *r) {
+  atomic_fetch_add(&r->head, 1);
+  gapcm_pipeline_wake(p);
+}
+
+/** Pushes the back slot of the given ring of the given pipeline. */
+static void gapcm_pipeline_push(struct GaPcmPipeline *p,
+                                struct GaPcmPipelineRing *r) {
+  atomic_fetch_add(&r->tail, 1);
+  gapcm_pipeline_wake(p);
+}
+
+/** Sets the given flag of the given pipeline. */
+static void gapcm_pipeline_set(struct GaPcmPipeline *p, atomic_bool *flag) {
+  atomic_store(flag, true);
+  gapcm_pipeline_wake(p);
+}
+
+/** Reads from the source ring of the given pipeline. See `GaPcmIo`. */
+static size_t gapcm_pipeline_ring_read(void *user, void *bytes, size_t count) {
+  struct GaPcmPipeline *p = user;
+  struct GaPcmPipelineSlot *slot = gapcm_pipeline_front(p, &p->rings[0]);
+  if (slot == NULL || slot->seek) {
+    return 0;
+  }
+  if (count > slot->count) {
+    count = slot->count;
+  }
+  memcpy(bytes, slot->bytes, count);
+  gapcm_pipeline_pop(p, &p->rings[0]);
+  return count;
+}
+
+/**
+ * Takes the seek of the reader from the source ring of the given pipeline. Its
+ * offset was the given one. See `GaPcmIo`.
+ */
+static int
+gapcm_pipeline_ring_seek(void *user,
+                         [[maybe_unused]] const unsigned long long offset) {
+  struct GaPcmPipeline *p = user;
+  struct GaPcmPipelineSlot *slot = gapcm_pipeline_front(p, &p->rings[0]);
+  if (slot == NULL || !slot->seek) {
+    errno = EIO;
+    return -1;
+  }
+  int out = slot->status;
+  if (out != GAPCM_SUCCESS) {
+    errno = slot->error;
+  }
+  gapcm_pipeline_pop(p, &p->rings[0]);
+  return out;
+}
+
+/**
+ * Writes to the output ring of the given pipeline. Fails once the writer has.
+ * See `GaPcmIo`.
+ */
+static size_t gapcm_pipeline_ring_write(void *user, const void *bytes,
+                                        const size_t count) {
+  struct GaPcmPipeline *p = user;
+  size_t out = 0;
+  while (out < count && !atomic_load(&p->failed)) {
+    struct GaPcmPipelineSlot *slot = gapcm_pipeline_back(p, &p->rings[1]);
+    slot->count = count - out < GAPCM_PIPELINE_SLOT_BYTES
+                      ? count - out
+                      : GAPCM_PIPELINE_SLOT_BYTES;
+    memcpy(slot->bytes, (const uint8_t *)bytes + out, slot->count);
+    out += slot->count;
+    gapcm_pipeline_push(p, &p->rings[1]);
+  }
+  return out;
+}
+
+/**
+ * Reads the given count of bytes from the source to the source ring of the
+ * given pipeline and returns the count of bytes read.
+ */
+static size_t gapcm_pipeline_read(struct GaPcmPipeline *p, const size_t count) {
+  struct GaPcmPipelineSlot *slot = gapcm_pipeline_back(p, &p->rings[0]);
+  if (slot == NULL) {
+    return 0;
+  }
+  slot->seek = false;
+  slot->count = gapcm_io_read(p->source, slot->bytes, count);
+  size_t out = slot->count;
+  if (out != count) {
+    p->errors[0] = errno;
+  }
+  gapcm_pipeline_push(p, &p->rings[0]);
+  return out;
+}
+
+/**
+ * Reads the sectors that decoding the given count of samples takes from the
+ * source of the given pipeline and returns whether they were enough. As in
+ * `gapcm_decode_context_for`, a short sector ends the reads after its group,
+ * which falls short only if the sector of the first channel does.
+ */
+static bool gapcm_pipeline_read_for(struct GaPcmPipeline *p,
+                                    unsigned long long count) {
+  uint16_t channel_count = p->session->CHANNEL_COUNT;
+  bool whole = true;
+  while (whole && count >= channel_count) {
+    size_t count_block = count / channel_count < GAPCM_BLOCK_BYTES
+                             ? count / channel_count
+                             : GAPCM_BLOCK_BYTES;
+    size_t count_first = 0;
+    for (size_t channel = 0; whole && channel < channel_count; channel++) {
+      size_t count_read = gapcm_pipeline_read(p, GAPCM_SECTOR_BYTES);
+      if (channel == 0) {
+        count_first = count_read;
+      }
+      whole = count_read == GAPCM_SECTOR_BYTES;
+    }
+    if ((count_first + GAPCM_SECTOR_BLOCKS - 1) / GAPCM_SECTOR_BLOCKS <
+        count_block) {
+      return false;
+    }
+    count -= channel_count * count_block;
+  }
+  return count < channel_count;
+}
+
+/**
+ * Reads the sectors of a loop of the given count of samples from the source of
+ * the given pipeline like `gapcm_pipeline_read_for`. See
+ * `gapcm_decode_context_for_loop`.
+ */
+static bool gapcm_pipeline_read_for_loop(struct GaPcmPipeline *p,
+                                         unsigned long long count,
+                                         const bool looping) {
+  unsigned long long count_ahead =
+      looping ? gapcm_decode_ahead(p->session->CHANNEL_COUNT, count) : count;
+  bool out = gapcm_pipeline_read_for(p, count_ahead);
+  if (!looping || !out) {
+    return out;
+  }
+  gapcm_decode_prefetch(p->source, p->session->header);
+  return gapcm_pipeline_read_for(p, count - count_ahead);
+}
+
+/**
+ * Reads the frames that encoding the given count of samples takes from the
+ * source of the given pipeline. See `gapcm_encode_context_for`.
+ */
+static void gapcm_pipeline_read_frames(struct GaPcmPipeline *p,
+                                       unsigned long long count) {
+  struct GaPcmSession *c = p->session;
+  while (count >= c->CHANNEL_COUNT) {
+    size_t count_read = c->CHANNEL_COUNT * gapcm_encode_context_block(c, count);
+    if (gapcm_pipeline_read(p, count_read) != count_read) {
+      return;
+    }
+    count -= count_read;
+  }
+}
+
+/**
+ * Reads the sectors of the given count of loops from the source of the given
+ * pipeline, seeking to the mark between them. See `gapcm_decode_context_loop`.
+ */
+static void gapcm_pipeline_read_loop(struct GaPcmPipeline *p, int loop_count) {
+  if (loop_count < 1 && loop_count != GAPCM_LOOP_FOREVER) {
+    return;
+  }
+  unsigned long long length_loop = gapcm_decode_context_length(p->session);
+  while (gapcm_pipeline_read_for_loop(
+             p, length_loop,
+             loop_count == GAPCM_LOOP_FOREVER || loop_count > 1) &&
+         (loop_count == GAPCM_LOOP_FOREVER || --loop_count >= 1)) {
+    struct GaPcmPipelineSlot *slot = gapcm_pipeline_back(p, &p->rings[0]);
+    if (slot == NULL) {
+      return;
+    }
+    slot->seek = true;
+    slot->status =
+        p->source->SEEK(p->source->user,
+                        GAPCM_SECTOR_BYTES * (1ULL + p->session->header->mark));
+    slot->error = errno;
+    gapcm_pipeline_push(p, &p->rings[0]);
+    if (slot->status != GAPCM_SUCCESS) {
+      return;
+    }
+  }
+}
+
+/** Runs the reader of the given pipeline. */
+static void *gapcm_pipeline_reader(void *user) {
+  struct GaPcmPipeline *p = user;
+  unsigned long long mark = GAPCM_BLOCK_BYTES * p->session->header->mark;
+  if (p->session->CHANNEL_COUNT > 0) {
+    switch (p->run) {
+    case GAPCM_RUN_DECODE:
+      if (gapcm_pipeline_read_for(p, mark)) {
+        gapcm_pipeline_read_loop(p, p->loop_count);
+      }
+      break;
+    case GAPCM_RUN_DECODE_FOR:
+      gapcm_pipeline_read_for(p, p->count);
+      break;
+    case GAPCM_RUN_DECODE_LOOP:
+      gapcm_pipeline_read_loop(p, p->loop_count);
+      break;
+    case GAPCM_RUN_ENCODE_FOR:
+      gapcm_pipeline_read_frames(p, p->count);
+      break;
+    }
+  }
+  gapcm_pipeline_set(p, &p->rings[0].closed);
+  return NULL;
+}
+
+/**
+ * Runs the writer of the given pipeline. It stops writing on the first failure
+ * but drains its ring until closed.
+ */
+static void *gapcm_pipeline_writer(void *user) {
+  struct GaPcmPipeline *p = user;
+  struct GaPcmPipelineSlot *slot;
+  while ((slot = gapcm_pipeline_front(p, &p->rings[1])) != NULL) {
+    if (!atomic_load(&p->failed)) {
+      size_t count_write = gapcm_io_write(p->output, slot->bytes, slot->count);
+      p->write_count += count_write;
+      if (count_write != slot->count) {
+        p->errors[1] = errno;
+        atomic_store(&p->failed, true);
+      }
+    }
+    gapcm_pipeline_pop(p, &p->rings[1]);
+  }
+  return NULL;
+}
+
+/**
+ * Runs the given transcode on the given session between the given streams in a
+ * pipeline and returns the count of bytes written. Runs it serially instead if
+ * the pipeline can not start.
+ */
+static unsigned long long
+gapcm_session_run_pipeline(struct GaPcmSession *s, const struct GaPcmIo *source,
+                           const struct GaPcmIo *output,
+                           const enum GaPcmSessionRun run,
+                           const unsigned long long count,
+                           const int loop_count) {
+  struct GaPcmPipeline *p = calloc(1, sizeof(*p));
+  if (p == NULL) {
+    return gapcm_session_run_serial(gapcm_session_open(s, source, output), run,
+                                    count, loop_count);
+  }
+  p->ios[0] = (struct GaPcmIo){.READ = gapcm_pipeline_ring_read,
+                               .SEEK = gapcm_pipeline_ring_seek,
+                               .user = p};
+  p->ios[1] = (struct GaPcmIo){.WRITE = gapcm_pipeline_ring_write, .user = p};
+  p->session = s;
+  p->output = output;
+  p->source = source;
+  p->count = count;
+  p->loop_count = loop_count;
+  p->run = run;
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->condition, NULL);
+  pthread_t threads[2];
+  unsigned long long out;
+  if (pthread_create(&threads[1], NULL, gapcm_pipeline_writer, p) !=
+      GAPCM_SUCCESS) {
+    out = gapcm_session_run_serial(gapcm_session_open(s, source, output), run,
+                                   count, loop_count);
+  } else if (pthread_create(&threads[0], NULL, gapcm_pipeline_reader, p) !=
+             GAPCM_SUCCESS) {
+    gapcm_pipeline_set(p, &p->rings[1].closed);
+    pthread_join(threads[1], NULL);
+    out = gapcm_session_run_serial(gapcm_session_open(s, source, output), run,
+                                   count, loop_count);
+  } else {
+    gapcm_session_run_serial(gapcm_session_open(s, &p->ios[0], &p->ios[1]), run,
+                             count, loop_count);
+    gapcm_pipeline_set(p, &p->rings[0].cancelled);
+    pthread_join(threads[0], NULL);
+    gapcm_pipeline_set(p, &p->rings[1].closed);
+    pthread_join(threads[1], NULL);
+    gapcm_session_open(s, source, output);
+    for (size_t index = 0; index < 2; index++) {
+      if (p->errors[index] != 0) {
+        errno = p->errors[index];
+      }
+    }
+    out = p->write_count;
+  }
+  pthread_cond_destroy(&p->condition);
+  pthread_mutex_destroy(&p->mutex);
+  free(p);
+  return out;
+}
+
+/**
+ * Represents a parallel transcode. The whole groups of each segment, a block or
+ * sector for each channel, are numbered consecutively and claimed by workers in
+ * jobs.
+ */
+struct GaPcmParallel {
+  /** GAPCM header. */
+  const struct GaPcmHeader *header;
+  /** Source memory. */
+  const struct GaPcmIoMemory *source;
+  /** Segments. */
+  const struct GaPcmSegment *segments;
+  /** Number of the first whole group of each segment, then their total. */
+  unsigned long long *groups;
+  /** Output offsets of segments. */
+  unsigned long long *offsets;
+  /** Source and output byte counts of a group. */
+  unsigned long long counts[2];
+  /** Count of segments to transcode. */
+  size_t segment_count;
+  /** Number of the next group to claim. */
+  atomic_ullong group;
+  /** Count of bytes written. */
+  atomic_ullong write_count;
+  /** First `errno`. */
+  atomic_int error;
+  /** Output file descriptor. */
+  int output;
+  /** Transcode. */
+  enum GaPcmSessionRun run;
+};
+
+/** Sets the error of the given parallel transcode if unset. */
+static void gapcm_parallel_fail(struct GaPcmParallel *p, const int error) {
+  int expected = 0;
+  atomic_compare_exchange_strong(&p->error, &expected, error);
+}
+
+/**
+ * Returns the index of the segment of the given group number, which must be
+ * below the total. Segments without whole groups are skipped.
+ */
+static size_t gapcm_parallel_segment(const struct GaPcmParallel *p,
+                                     const unsigned long long group) {
+  size_t low = 0;
+  size_t high = p->segment_count - 1;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (p->groups[middle + 1] > group) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+
+/**
+ * Writes the given count of bytes from the given location to the output of the
+ * given parallel transcode at the given offset and returns its success.
+ */
+static bool gapcm_parallel_write(struct GaPcmParallel *p, const uint8_t *bytes,
+                                 size_t count, unsigned long long offset) {
+  while (count > 0) {
+    ssize_t count_write = pwrite(p->output, bytes, count, offset);
+    if (count_write < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count_write <= 0) {
+      gapcm_parallel_fail(p, count_write < 0 ? errno : EIO);
+      return false;
+    }
+    atomic_fetch_add(&p->write_count, count_write);
+    bytes += count_write;
+    count -= count_write;
+    offset += count_write;
+  }
+  return true;
+}
+
+/**
+ * Runs the transcode of the given parallel transcode with the given session
+ * from the given source position to the given location of the given count of
+ * bytes, for the given count of samples or bytes as `gapcm_session_run_serial`
+ * takes, and returns the count of bytes output.
+ */
+static unsigned long long
+gapcm_parallel_run(const struct GaPcmParallel *p, struct GaPcmSession *s,
+                   const unsigned long long position, uint8_t *frames,
+                   const size_t count_frames, const unsigned long long count) {
+  struct GaPcmIoMemory memories[] = {*p->source, {frames, count_frames, 0}};
+  memories[0].position =
+      position < p->source->count ? position : p->source->count;
+  struct GaPcmIo ios[2];
+  return gapcm_session_run_serial(
+      gapcm_session_open(s, gapcm_io_memory(&ios[0], &memories[0]),
+                         gapcm_io_memory(&ios[1], &memories[1])),
+      p->run, count, 0);
+}
 
-/** Runs the given decode context for the given count of samples. */
-static unsigned long long gapcm_decode_context_for(struct GaPcmIoContext *c,
-                                                   unsigned long long count) {
-  if (c->CHANNEL_COUNT <= 0) {
-    return 0;
+/** Runs jobs of whole groups of the given parallel transcode until none. */
+static void *gapcm_parallel_worker(void *user) {
+  struct GaPcmParallel *p = user;
+  struct GaPcmSession *s = gapcm_session_make(p->header);
+  uint8_t *frames = malloc(p->counts[1] * GAPCM_PARALLEL_GROUPS);
+  if (s == NULL || frames == NULL) {
+    gapcm_parallel_fail(p, ENOMEM);
   }
-  unsigned long long out = 0;
-  bool error = false;
-  while (!error && count >= c->CHANNEL_COUNT) {
-    for (size_t channel = 0; !error && channel < c->CHANNEL_COUNT; channel++) {
-      c->counts[channel] = gapcm_decode_sector(
-          c->sector, fread(c->sector, 1, GAPCM_SECTOR_BYTES, c->source),
-          &c->blocks[GAPCM_BLOCK_BYTES * channel]);
-      if (c->counts[channel] != GAPCM_BLOCK_BYTES) {
-        error = true;
-      }
-      if (c->counts[channel] > count / c->CHANNEL_COUNT) {
-        c->counts[channel] = count / c->CHANNEL_COUNT;
-      }
-      c->indexes[channel] = 0;
-    }
-    for (size_t channel = 0;; channel = (channel + 1) % c->CHANNEL_COUNT) {
-      const void *ptr;
-      if (c->indexes[channel] < c->counts[channel]) {
-        ptr = &c->blocks[GAPCM_BLOCK_BYTES * channel + c->indexes[channel]];
-        c->indexes[channel] += GAPCM_SAMPLE_BYTES;
-      } else if (channel > 0) {
-        ptr = &gapcm_sample_origin;
-      } else {
+  unsigned long long total = p->groups[p->segment_count];
+  while (atomic_load(&p->error) == 0) {
+    unsigned long long group =
+        atomic_fetch_add(&p->group, GAPCM_PARALLEL_GROUPS);
+    if (group >= total) {
+      break;
+    }
+    unsigned long long end = total - group < GAPCM_PARALLEL_GROUPS
+                                 ? total
+                                 : group + GAPCM_PARALLEL_GROUPS;
+    while (group < end) {
+      size_t segment = gapcm_parallel_segment(p, group);
+      unsigned long long index = group - p->groups[segment];
+      unsigned long long count =
+          (p->groups[segment + 1] < end ? p->groups[segment + 1] : end) -
+          group;
+      unsigned long long count_frames = gapcm_parallel_run(
+          p, s, p->segments[segment].position + p->counts[0] * index, frames,
+          p->counts[1] * count,
+          p->counts[p->run == GAPCM_RUN_DECODE_FOR] * count);
+      if (!gapcm_parallel_write(p, frames, count_frames,
+                                p->offsets[segment] + p->counts[1] * index)) {
         break;
       }
-      if (fwrite(ptr, 1, GAPCM_SAMPLE_BYTES, c->output) != GAPCM_SAMPLE_BYTES) {
-        return out;
-      }
-      out += GAPCM_SAMPLE_BYTES;
+      group += count;
     }
-    count -= c->counts[0] * c->CHANNEL_COUNT;
   }
-  return out;
+  free(frames);
+  gapcm_session_free(s);
+  return NULL;
 }
 
-static unsigned long long
-gapcm_decode_context_loop(struct GaPcmIoContext *context, int loop_count) {
-  if (loop_count < 1) {
-    return 0;
+/**
+ * Plans the given parallel decode from the given offset with the given session,
+ * decoding and writing each segment tail along the way. Segments are planned up
+ * to and including the first that falls short.
+ */
+static void gapcm_parallel_plan(struct GaPcmParallel *p,
+                                struct GaPcmSession *s,
+                                unsigned long long offset,
+                                const size_t segment_count) {
+  uint8_t *frames = malloc(p->counts[1]);
+  if (frames == NULL) {
+    gapcm_parallel_fail(p, ENOMEM);
+    return;
   }
-  unsigned long long length_loop =
-      GAPCM_SAMPLE_BYTES * context->header->length * context->CHANNEL_COUNT -
-      GAPCM_BLOCK_BYTES * context->header->mark;
-  unsigned long long out = 0;
-  while (true) {
-    unsigned long long count_decode =
-        gapcm_decode_context_for(context, length_loop);
-    out += count_decode;
-    if (count_decode != length_loop || --loop_count < 1 ||
-        gapcm_decode_seek(context->source, context->header->mark) !=
-            GAPCM_SUCCESS) {
+  struct GaPcmSegment tail = {0, 0};
+  unsigned long long count_tail = 0;
+  p->groups[0] = 0;
+  for (size_t index = 0; index < segment_count; index++) {
+    const struct GaPcmSegment *segment = &p->segments[index];
+    unsigned long long count_left = segment->position < p->source->count
+                                        ? p->source->count - segment->position
+                                        : 0;
+    unsigned long long groups = segment->count / p->counts[1];
+    if (groups > count_left / p->counts[0]) {
+      groups = count_left / p->counts[0];
+    }
+    p->groups[index + 1] = p->groups[index] + groups;
+    p->offsets[index] = offset;
+    p->segment_count = index + 1;
+    offset += p->counts[1] * groups;
+    struct GaPcmSegment next = {segment->position + p->counts[0] * groups,
+                                segment->count - p->counts[1] * groups};
+    if (index == 0 || tail.position != next.position ||
+        tail.count != next.count) {
+      count_tail = gapcm_parallel_run(
+          p, s, next.position, frames, p->counts[1],
+          next.count < p->counts[1] ? next.count : p->counts[1]);
+      tail = next;
+    }
+    if (!gapcm_parallel_write(p, frames, count_tail, offset)) {
+      break;
+    }
+    offset += count_tail;
+    if (p->counts[1] * groups + count_tail != segment->count) {
       break;
     }
   }
-  return out;
+  free(frames);
 }
 
-/** Runs the given encode context for the given count of samples. */
-static unsigned long long gapcm_encode_context_for(struct GaPcmIoContext *c,
-                                                   unsigned long long count) {
-  if (c->CHANNEL_COUNT <= 0) {
-    return 0;
+/**
+ * Runs the planned jobs of the given parallel transcode in the given count of
+ * threads including the calling one, `0` for one per processor, and returns
+ * the count of bytes written. Sets `errno` on failure.
+ */
+static unsigned long long gapcm_parallel_start(struct GaPcmParallel *p,
+                                               unsigned thread_count) {
+  if (thread_count <= 0) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = count > 0 ? count : 1;
   }
-  unsigned long long out = 0;
-  bool error = false;
-  while (!error && count >= c->CHANNEL_COUNT) {
-    size_t count_block = count / c->CHANNEL_COUNT > GAPCM_BLOCK_BYTES
-                             ? GAPCM_BLOCK_BYTES
-                             : count / c->CHANNEL_COUNT;
-    for (size_t channel = 0; channel < c->CHANNEL_COUNT; channel++) {
-      c->counts[channel] = 0;
-      c->indexes[channel] = 0;
-    }
-    for (size_t channel = 0; c->indexes[channel] < count_block;
-         channel = (channel + 1) % c->CHANNEL_COUNT) {
-      if (fread(&c->blocks[GAPCM_BLOCK_BYTES * channel + c->indexes[channel]],
-                1, GAPCM_SAMPLE_BYTES, c->source) != GAPCM_SAMPLE_BYTES) {
-        error = true;
-        break;
-      }
-      c->counts[channel] += GAPCM_SAMPLE_BYTES;
-      c->indexes[channel] += GAPCM_SAMPLE_BYTES;
+  if (atomic_load(&p->error) == 0) {
+    pthread_t *threads = malloc(sizeof(*threads) * thread_count);
+    unsigned count = 0;
+    while (threads != NULL && count + 1 < thread_count &&
+           pthread_create(&threads[count], NULL, gapcm_parallel_worker, p) ==
+               GAPCM_SUCCESS) {
+      count++;
     }
-    for (size_t channel = 0;
-         channel < c->CHANNEL_COUNT && c->counts[channel] > 0; channel++) {
-      for (size_t index = c->counts[channel]; index < GAPCM_BLOCK_BYTES;
-           index += GAPCM_SAMPLE_BYTES) {
-        memcpy(&c->blocks[GAPCM_BLOCK_BYTES * channel + index],
-               &gapcm_sample_origin[GAPCM_SAMPLE_BYTES_PAD],
-               GAPCM_SAMPLE_BYTES);
-      }
-      count -= c->counts[channel];
-      unsigned long count_write =
-          fwrite(c->sector, 1,
-                 gapcm_encode_sector(&c->blocks[GAPCM_BLOCK_BYTES * channel],
-                                     GAPCM_BLOCK_BYTES, c->sector),
-                 c->output);
-      out += count_write;
-      if (count_write / GAPCM_SECTOR_BLOCKS != GAPCM_BLOCK_BYTES) {
-        return out;
-      }
+    gapcm_parallel_worker(p);
+    while (count > 0) {
+      pthread_join(threads[--count], NULL);
     }
+    free(threads);
   }
-  return out;
+  if (atomic_load(&p->error) != 0) {
+    errno = atomic_load(&p->error);
+  }
+  return atomic_load(&p->write_count);
 }
+#endif
 
-/** Frees the given transcoding context. */
-static struct GaPcmIoContext *gapcm_iocontext_free(struct GaPcmIoContext *c) {
-  free(c->blocks);
-  free(c->counts);
-  free(c->indexes);
-  free(c->sector);
-  free(c);
-  return NULL;
+/**
+ * Runs the given transcode on the given session between the given streams for
+ * the given count of samples or loops, in a pipeline if set.
+ */
+static unsigned long long
+gapcm_session_run(struct GaPcmSession *s, const struct GaPcmIo *source,
+                  const struct GaPcmIo *output, const enum GaPcmSessionRun run,
+                  const unsigned long long count, const int loop_count) {
+#ifndef _WIN32
+  if (s->pipeline) {
+    return gapcm_session_run_pipeline(s, source, output, run, count,
+                                      loop_count);
+  }
+#endif
+  return gapcm_session_run_serial(gapcm_session_open(s, source, output), run,
+                                  count, loop_count);
 }
 
-/** Makes a transcoding context with the given. */
-static struct GaPcmIoContext *
-gapcm_iocontext_make(const struct GaPcmHeader *header, FILE *restrict stream,
-                     FILE *restrict output) {
-  struct GaPcmIoContext *out = malloc(sizeof(*out));
-  out->CHANNEL_COUNT = gapcm_to_channelcount(header->format);
-  out->blocks =
-      malloc(sizeof(*out->blocks) * GAPCM_BLOCK_BYTES * out->CHANNEL_COUNT);
-  out->counts = malloc(sizeof(*out->counts) * out->CHANNEL_COUNT);
-  out->header = header;
-  out->indexes = malloc(sizeof(*out->indexes) * out->CHANNEL_COUNT);
-  out->output = output;
-  out->sector = malloc(sizeof(*out->sector) * GAPCM_SECTOR_BYTES);
-  out->source = stream;
-  return out;
+static bool gapcm_decoder_fill(struct GaPcmDecoder *d);
+
+/**
+ * Moves the given decoder to the given offset into the given phase of the given
+ * count of bytes, which reads from the given source position, and returns its
+ * success. Only the sector of each channel holding the offset is decoded.
+ */
+static bool gapcm_decoder_seek_phase(struct GaPcmDecoder *d,
+                                     const enum GaPcmDecoderPhase phase,
+                                     const unsigned long long position,
+                                     const unsigned long long count,
+                                     const unsigned long long offset) {
+  unsigned long long count_group =
+      GAPCM_BLOCK_BYTES * d->session->CHANNEL_COUNT;
+  unsigned long long group = offset / count_group;
+  d->phase = phase;
+  d->count = count - count_group * group;
+  if (d->source.SEEK(d->source.user,
+                     position + GAPCM_SECTOR_BYTES *
+                                    d->session->CHANNEL_COUNT * group) !=
+          GAPCM_SUCCESS ||
+      !gapcm_decoder_fill(d) ||
+      d->frames_count <= offset - count_group * group) {
+    d->phase = GAPCM_PHASE_DONE;
+    d->frames_count = 0;
+    return false;
+  }
+  d->frames_index = offset - count_group * group;
+  return true;
+}
+
+/**
+ * Moves the given decoder to its phase after the current and returns its
+ * success. Loops and the trail after them restart from the mark.
+ */
+static bool gapcm_decoder_advance(struct GaPcmDecoder *d) {
+  struct GaPcmSession *c = gapcm_session_open(d->session, &d->source, NULL);
+  enum GaPcmDecoderPhase phase = d->phase;
+  if (d->end) {
+    d->phase = GAPCM_PHASE_DONE;
+  } else if (phase == GAPCM_PHASE_PREGAP) {
+    d->phase = GAPCM_PHASE_INTRO;
+    d->count = GAPCM_BLOCK_BYTES * c->header->mark;
+  } else if ((phase == GAPCM_PHASE_INTRO || phase == GAPCM_PHASE_LOOP) &&
+             d->loop_count > 0) {
+    d->loop_count--;
+    d->phase = GAPCM_PHASE_LOOP;
+    d->count = gapcm_decode_context_length(c);
+  } else if (phase == GAPCM_PHASE_INTRO && d->trail) {
+    unsigned long long mark = GAPCM_BLOCK_BYTES * c->header->mark;
+    d->phase = GAPCM_PHASE_TRAIL;
+    d->count = (unsigned long long)UINT32_MAX * c->CHANNEL_COUNT - mark;
+    if (mark % (GAPCM_BLOCK_BYTES * c->CHANNEL_COUNT) != 0) {
+      // Continues within the last sector of each channel of the intro, which
+      // is decoded again, as one run from the stream start would.
+      return gapcm_decoder_seek_phase(
+          d, GAPCM_PHASE_TRAIL, GAPCM_SECTOR_BYTES,
+          (unsigned long long)UINT32_MAX * c->CHANNEL_COUNT, mark);
+    }
+  } else if (phase == GAPCM_PHASE_LOOP && d->trail) {
+    d->phase = GAPCM_PHASE_TRAIL;
+    d->count = (unsigned long long)UINT32_MAX * c->CHANNEL_COUNT;
+  } else {
+    d->phase = GAPCM_PHASE_DONE;
+  }
+  if (phase == GAPCM_PHASE_LOOP && d->phase != GAPCM_PHASE_DONE &&
+      gapcm_decode_context_seek(c) != GAPCM_SUCCESS) {
+    d->phase = GAPCM_PHASE_DONE;
+  }
+  return d->phase != GAPCM_PHASE_DONE;
+}
+
+/**
+ * Decodes the next frames of the given decoder within its phase and returns
+ * its success. A phase ends when its count of bytes runs out.
+ */
+static bool gapcm_decoder_fill(struct GaPcmDecoder *d) {
+  struct GaPcmSession *c = gapcm_session_open(d->session, &d->source, NULL);
+  d->frames_index = 0;
+  d->frames_count = 0;
+  if (d->phase == GAPCM_PHASE_DONE) {
+    return false;
+  }
+  if (d->phase == GAPCM_PHASE_PREGAP) {
+    if (d->count == 0) {
+      return gapcm_decoder_advance(d);
+    }
+    d->frames = gapcm_silence;
+    d->frames_count =
+        d->count < GAPCM_SILENCE_BYTES ? d->count : GAPCM_SILENCE_BYTES;
+    d->count -= d->frames_count;
+    return true;
+  }
+  if (d->count < c->CHANNEL_COUNT) {
+    return gapcm_decoder_advance(d);
+  }
+  bool error = false;
+  for (size_t channel = 0; !error && channel < c->CHANNEL_COUNT; channel++) {
+    error = !gapcm_decode_context_next(c, channel, d->count);
+  }
+  d->frames = c->blocks;
+  if (c->CHANNEL_COUNT > 1) {
+    gapcm_decode_context_interleave(c, c->frames);
+    d->frames = c->frames;
+  }
+  d->frames_count = gapcm_decode_context_count(c);
+  d->count -= c->counts[0] * c->CHANNEL_COUNT;
+  d->end = error;
+  if (error && d->frames_count == 0) {
+    d->phase = GAPCM_PHASE_DONE;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Appends a part of the given kind from the given source position for the
+ * given count of output bytes to the given plan, unless empty.
+ */
+static void gapcm_plan_add(struct GaPcmPlan *p, const enum GaPcmPartKind kind,
+                           const unsigned long long position,
+                           const unsigned long long count) {
+  if (count > 0) {
+    p->parts[p->part_count++] =
+        (struct GaPcmPart){{position, count}, p->count, kind};
+    p->count += count;
+  }
+}
+
+/**
+ * Appends a source part from the given position for up to the given count of
+ * output bytes to the given plan and returns whether it was whole. A source of
+ * the given count of bytes is read a sector of each channel at a time, and the
+ * sector of the first channel sizes each output block, as decoding does.
+ */
+static bool gapcm_plan_add_source(struct GaPcmPlan *p,
+                                  const unsigned long long position,
+                                  const unsigned long long count,
+                                  const unsigned long long source_count,
+                                  const uint16_t channel_count) {
+  unsigned long long count_source =
+      source_count > position ? source_count - position : 0;
+  unsigned long long count_group = GAPCM_SECTOR_BYTES * channel_count;
+  unsigned long long out =
+      count_source / count_group * GAPCM_BLOCK_BYTES * channel_count;
+  size_t count_sector = count_source % count_group < GAPCM_SECTOR_BYTES
+                            ? count_source % count_group
+                            : GAPCM_SECTOR_BYTES;
+  if (count_sector > GAPCM_SAMPLE_BYTES_PAD) {
+    out += channel_count *
+           ((count_sector - GAPCM_SAMPLE_BYTES_PAD + GAPCM_SECTOR_BLOCKS - 1) /
+            GAPCM_SECTOR_BLOCKS);
+  }
+  gapcm_plan_add(p, GAPCM_PART_SOURCE, position, out < count ? out : count);
+  return out >= count;
 }
 
 /** Returns the smaller of the two given unsigned 8-bit integers. */
@@ -214,10 +1574,62 @@ size_t gapcm_decode_header(uint8_t *restrict sector,
 unsigned long long gapcm_decode_loop(const struct GaPcmHeader *header,
                                      FILE *restrict source,
                                      FILE *restrict output, int loop_count) {
-  struct GaPcmIoContext *context = gapcm_iocontext_make(header, source, output);
-  unsigned long long out = gapcm_decode_context_loop(context, loop_count);
-  context = gapcm_iocontext_free(context);
-  return out;
+  uint8_t memory[GAPCM_SESSION_BYTES];
+  return gapcm_session_decode_loop(
+      gapcm_session_make_at(header, memory, GAPCM_SESSION_BYTES), source,
+      output, loop_count);
+}
+
+unsigned long long gapcm_decode_plan(const struct GaPcmHeader *header,
+                                     const unsigned long long source_count,
+                                     const int loop_count, const bool trail,
+                                     struct GaPcmPlan *plan) {
+  uint16_t channel_count = gapcm_to_channelcount(header->format);
+  unsigned long long count_group = GAPCM_BLOCK_BYTES * channel_count;
+  unsigned long long mark = GAPCM_BLOCK_BYTES * header->mark;
+  unsigned long long length_loop =
+      GAPCM_SAMPLE_BYTES * header->length * channel_count - mark;
+  unsigned long long loops = loop_count > 0 ? loop_count - trail : 0;
+  // The first loop continues where the intro left off reading whole sectors of
+  // each channel. Later ones restart from the mark.
+  unsigned long long positions[] = {
+      GAPCM_SECTOR_BYTES *
+          (1 + (mark + count_group - 1) / count_group * channel_count),
+      GAPCM_SECTOR_BYTES * (1ULL + header->mark)};
+  plan->part_count = 0;
+  plan->count = 0;
+  plan->whole = true;
+  gapcm_plan_add(plan, GAPCM_PART_SILENCE, 0,
+                 GAPCM_BLOCK_BYTES * header->pregap);
+  if (trail && loops == 0) {
+    // One run from the stream start, without a break at the mark.
+    gapcm_plan_add_source(plan, GAPCM_SECTOR_BYTES,
+                          (unsigned long long)UINT32_MAX * channel_count,
+                          source_count, channel_count);
+    return plan->count;
+  }
+  if (!gapcm_plan_add_source(plan, GAPCM_SECTOR_BYTES, mark, source_count,
+                             channel_count)) {
+    plan->whole = false;
+    return plan->count;
+  }
+  for (unsigned long long loop = 0; loop < loops && loop < 2; loop++) {
+    if (!gapcm_plan_add_source(plan, positions[loop > 0], length_loop,
+                               source_count, channel_count)) {
+      plan->whole = false;
+      return plan->count;
+    }
+  }
+  if (loops > 2) {
+    gapcm_plan_add(plan, GAPCM_PART_REPEAT, positions[1],
+                   length_loop * (loops - 2));
+  }
+  if (trail) {
+    gapcm_plan_add_source(plan, positions[1],
+                          (unsigned long long)UINT32_MAX * channel_count,
+                          source_count, channel_count);
+  }
+  return plan->count;
 }
 
 unsigned long long gapcm_decode_pregap(const uint8_t pregap,
@@ -232,51 +1644,27 @@ uint8_t gapcm_decode_sample(const uint8_t sample) {
 
 size_t gapcm_decode_sector(const uint8_t *restrict sector, const size_t count,
                            uint8_t *restrict block) {
-  size_t out = 0;
-  for (size_t offset = GAPCM_SAMPLE_BYTES_PAD; offset < count;
-       offset = ++out * GAPCM_SECTOR_BLOCKS + GAPCM_SAMPLE_BYTES_PAD) {
-    block[out] = gapcm_decode_sample(sector[offset]);
-  }
-  return out;
+  return gapcm_simd_kernel()->DECODE(sector, count, block);
 }
 
-#define GAPCM_OFFSET_MAXIMUM UINT32_MAX / GAPCM_SECTOR_BYTES
-int gapcm_decode_seek(FILE *restrict file, uint32_t position) {
-  int errnoo = errno;
-  int out = fflush(file);
-  if (out != GAPCM_SUCCESS) {
-#ifdef GAPCM_FFLUSH_EBADF
-    if (errno != EBADF) {
-      return out;
-    }
-    errno = errnoo;
-#else
-    return out;
-#endif
-  }
-  out = fseek(file, GAPCM_SECTOR_BYTES, SEEK_SET);
-  if (out != GAPCM_SUCCESS) {
-    return out;
-  }
-  while (position >= GAPCM_OFFSET_MAXIMUM) {
-    out = fseek(file, GAPCM_SECTOR_BYTES * GAPCM_OFFSET_MAXIMUM, SEEK_CUR);
-    if (out != GAPCM_SUCCESS) {
-      return out;
-    }
-    position -= GAPCM_OFFSET_MAXIMUM;
-  }
-  return fseek(file, GAPCM_SECTOR_BYTES * position, SEEK_CUR);
+int gapcm_decode_seek(FILE *restrict file, const uint32_t position) {
+  struct GaPcmIo io;
+  gapcm_io_file(&io, file);
+  return io.SEEK(io.user, GAPCM_SECTOR_BYTES * (1ULL + position));
 }
-#undef GAPCM_OFFSET_MAXIMUM
 
 unsigned long long gapcm_decode_silence(uint32_t count, FILE *restrict file) {
   unsigned long long out = 0;
-  while (count-- > 0) {
-    if (fwrite(&gapcm_sample_origin[GAPCM_SAMPLE_BYTES_PAD], 1,
-               GAPCM_SAMPLE_BYTES, file) != GAPCM_SAMPLE_BYTES) {
+  while (count > 0) {
+    size_t count_silence = count < GAPCM_SILENCE_BYTES / GAPCM_SAMPLE_BYTES
+                               ? GAPCM_SAMPLE_BYTES * count
+                               : GAPCM_SILENCE_BYTES;
+    size_t count_write = fwrite(gapcm_silence, 1, count_silence, file);
+    out += count_write - count_write % GAPCM_SAMPLE_BYTES;
+    if (count_write != count_silence) {
       break;
     }
-    out += GAPCM_SAMPLE_BYTES;
+    count -= count_silence / GAPCM_SAMPLE_BYTES;
   }
   return out;
 }
@@ -284,27 +1672,142 @@ unsigned long long gapcm_decode_silence(uint32_t count, FILE *restrict file) {
 unsigned long long gapcm_decode_stream(const struct GaPcmHeader *header,
                                        FILE *restrict source,
                                        FILE *restrict output, int loop_count) {
-  struct GaPcmIoContext *context = gapcm_iocontext_make(header, source, output);
-  unsigned long long mark = GAPCM_BLOCK_BYTES * context->header->mark;
-  unsigned long long out = gapcm_decode_context_for(context, mark);
-  if (out == mark) {
-    out += gapcm_decode_context_loop(context, loop_count);
-  }
-  context = gapcm_iocontext_free(context);
-  return out;
+  uint8_t memory[GAPCM_SESSION_BYTES];
+  return gapcm_session_decode_stream(
+      gapcm_session_make_at(header, memory, GAPCM_SESSION_BYTES), source,
+      output, loop_count);
 }
 
 unsigned long long gapcm_decode_stream_for(const struct GaPcmHeader *header,
                                            FILE *restrict source,
                                            FILE *restrict output,
                                            const uint32_t count) {
-  struct GaPcmIoContext *context = gapcm_iocontext_make(header, source, output);
-  unsigned long long out =
-      gapcm_decode_context_for(context, count * context->CHANNEL_COUNT);
-  context = gapcm_iocontext_free(context);
+  uint8_t memory[GAPCM_SESSION_BYTES];
+  return gapcm_session_decode_stream_for(
+      gapcm_session_make_at(header, memory, GAPCM_SESSION_BYTES), source,
+      output, count);
+}
+
+struct GaPcmDecoder *gapcm_decoder_free(struct GaPcmDecoder *d) {
+  free(d);
+  return NULL;
+}
+
+struct GaPcmDecoder *gapcm_decoder_make(struct GaPcmSession *session,
+                                        FILE *source, const int loop_count,
+                                        const bool trail) {
+  struct GaPcmIo io;
+  return gapcm_decoder_make_io(session, gapcm_io_file(&io, source), loop_count,
+                               trail);
+}
+
+struct GaPcmDecoder *gapcm_decoder_make_io(struct GaPcmSession *session,
+                                           const struct GaPcmIo *source,
+                                           const int loop_count,
+                                           const bool trail) {
+  struct GaPcmDecoder *out = malloc(sizeof(*out));
+  if (out == NULL) {
+    return NULL;
+  }
+  out->count = GAPCM_BLOCK_BYTES * session->header->pregap;
+  out->frames = NULL;
+  out->frames_count = 0;
+  out->frames_index = 0;
+  out->loop_count = trail && loop_count > 0 ? loop_count - 1 : loop_count;
+  out->loops = out->loop_count;
+  out->phase = GAPCM_PHASE_PREGAP;
+  out->session = session;
+  out->source = *source;
+  out->trail = trail;
+  out->end = false;
+  return out;
+}
+
+size_t gapcm_decoder_next(struct GaPcmDecoder *d, const uint32_t count,
+                          const uint8_t **frames) {
+  while (d->frames_index >= d->frames_count) {
+    if (!gapcm_decoder_fill(d)) {
+      return 0;
+    }
+  }
+  size_t out = d->frames_count - d->frames_index;
+  if (out > GAPCM_SAMPLE_BYTES * d->session->CHANNEL_COUNT * (size_t)count) {
+    out = GAPCM_SAMPLE_BYTES * d->session->CHANNEL_COUNT * (size_t)count;
+  }
+  *frames = &d->frames[d->frames_index];
+  d->frames_index += out;
   return out;
 }
 
+enum GaPcmDecoderPhase gapcm_decoder_phase(const struct GaPcmDecoder *d) {
+  return d->phase;
+}
+
+bool gapcm_decoder_seek(struct GaPcmDecoder *d,
+                        const unsigned long long frame) {
+  struct GaPcmSession *c = gapcm_session_open(d->session, &d->source, NULL);
+  unsigned long long count_frame = GAPCM_SAMPLE_BYTES * c->CHANNEL_COUNT;
+  unsigned long long count_group = GAPCM_BLOCK_BYTES * c->CHANNEL_COUNT;
+  unsigned long long pregap = GAPCM_BLOCK_BYTES * c->header->pregap;
+  unsigned long long mark = GAPCM_BLOCK_BYTES * c->header->mark;
+  unsigned long long length_loop = gapcm_decode_context_length(c);
+  unsigned long long loops =
+      d->loops > 0 && length_loop > 0 ? (unsigned long long)d->loops : 0;
+  // The first loop continues where the intro left off reading whole sectors of
+  // each channel, as serial decoding does. Later ones restart from the mark.
+  unsigned long long positions[] = {
+      GAPCM_SECTOR_BYTES *
+          (1 + (mark + count_group - 1) / count_group * c->CHANNEL_COUNT),
+      GAPCM_SECTOR_BYTES * (1ULL + c->header->mark)};
+  unsigned long long offset = count_frame * frame;
+  d->frames_count = 0;
+  d->frames_index = 0;
+  d->end = false;
+  if (d->source.SEEK == NULL ||
+      (frame != 0 && offset / frame != count_frame)) {
+    d->phase = GAPCM_PHASE_DONE;
+    return false;
+  }
+  if (offset < pregap) {
+    d->phase = GAPCM_PHASE_PREGAP;
+    d->count = pregap - offset;
+    d->loop_count = d->loops;
+    if (d->source.SEEK(d->source.user, GAPCM_SECTOR_BYTES) != GAPCM_SUCCESS) {
+      d->phase = GAPCM_PHASE_DONE;
+    }
+    return d->phase != GAPCM_PHASE_DONE;
+  }
+  offset -= pregap;
+  if (offset < mark) {
+    d->loop_count = d->loops;
+    return gapcm_decoder_seek_phase(d, GAPCM_PHASE_INTRO, GAPCM_SECTOR_BYTES,
+                                    mark, offset);
+  }
+  offset -= mark;
+  unsigned long long loop = loops > 0 ? offset / length_loop : 0;
+  if (loop < loops) {
+    d->loop_count = loops - loop - 1;
+    return gapcm_decoder_seek_phase(d, GAPCM_PHASE_LOOP, positions[loop > 0],
+                                    length_loop, offset - length_loop * loop);
+  }
+  offset -= length_loop * loops;
+  unsigned long long length_trail =
+      (unsigned long long)UINT32_MAX * c->CHANNEL_COUNT -
+      (loops > 0 ? 0 : mark);
+  d->loop_count = 0;
+  if (!d->trail || offset >= length_trail) {
+    d->phase = GAPCM_PHASE_DONE;
+    return false;
+  }
+  if (loops == 0) {
+    // One run from the stream start. See `gapcm_decoder_advance`.
+    return gapcm_decoder_seek_phase(d, GAPCM_PHASE_TRAIL, GAPCM_SECTOR_BYTES,
+                                    length_trail + mark, offset + mark);
+  }
+  return gapcm_decoder_seek_phase(d, GAPCM_PHASE_TRAIL, positions[1],
+                                  length_trail, offset);
+}
+
 size_t gapcm_encode_header(struct GaPcmHeader *header, uint8_t *sector) {
   uint32_t longg = htonl(header->mark);
   uint16_t shortt = htons(header->format);
@@ -350,14 +1853,7 @@ uint8_t gapcm_encode_sample(const uint8_t sample) {
 
 size_t gapcm_encode_sector(const uint8_t *restrict block, const size_t count,
                            uint8_t *restrict sector) {
-  size_t out = 0;
-  for (size_t index = 0; index < count; out = ++index * GAPCM_SECTOR_BLOCKS) {
-#if GAPCM_SAMPLE_BYTES_PAD == 1
-    sector[out] = 0;
-#endif
-    sector[out + GAPCM_SAMPLE_BYTES_PAD] = gapcm_encode_sample(block[index]);
-  }
-  return out;
+  return gapcm_simd_kernel()->ENCODE(block, count, sector);
 }
 
 unsigned long long gapcm_encode_stream(const struct GaPcmHeader *header,
@@ -370,11 +1866,10 @@ unsigned long long gapcm_encode_stream_for(const struct GaPcmHeader *header,
                                            FILE *restrict source,
                                            FILE *restrict output,
                                            const uint32_t count) {
-  struct GaPcmIoContext *context = gapcm_iocontext_make(header, source, output);
-  unsigned long long out =
-      gapcm_encode_context_for(context, count * context->CHANNEL_COUNT);
-  context = gapcm_iocontext_free(context);
-  return out;
+  uint8_t memory[GAPCM_SESSION_BYTES];
+  return gapcm_session_encode_stream_for(
+      gapcm_session_make_at(header, memory, GAPCM_SESSION_BYTES), source,
+      output, count);
 }
 
 bool gapcm_header_check(const struct GaPcmHeader *header, const char **error) {
@@ -420,6 +1915,286 @@ int gapcm_header_stringify(const struct GaPcmHeader *h, char *restrict string) {
       h->echo_levels[1], h->echo_levels[2], h->pregap);
 }
 
+bool gapcm_session_bind(struct GaPcmSession *s,
+                        const struct GaPcmHeader *header) {
+  uint16_t channel_count = gapcm_to_channelcount(header->format);
+  if (channel_count > s->CHANNEL_CAPACITY) {
+    return false;
+  }
+  s->CHANNEL_COUNT = channel_count;
+  s->header = header;
+  return true;
+}
+
+size_t gapcm_session_bytes(const struct GaPcmHeader *header) {
+  return GAPCM_SESSION_ALIGNMENT - 1 +
+         (sizeof(struct GaPcmSession) + GAPCM_SESSION_ALIGNMENT - 1) /
+             GAPCM_SESSION_ALIGNMENT * GAPCM_SESSION_ALIGNMENT +
+         GAPCM_SECTOR_BYTES +
+         2 * GAPCM_BLOCK_BYTES * gapcm_to_channelcount(header->format);
+}
+
+size_t gapcm_session_cache(struct GaPcmSession *s, const size_t capacity) {
+  s->cache = capacity;
+  return s->cache;
+}
+
+unsigned long long gapcm_session_decode_buffer(struct GaPcmSession *s,
+                                               struct GaPcmBuffers *buffers,
+                                               const int loop_count) {
+  unsigned long long mark = GAPCM_BLOCK_BYTES * s->header->mark;
+  unsigned long long out = gapcm_decode_context_buffer(s, buffers, mark);
+  if (out == mark) {
+    out += gapcm_decode_context_buffer_loop(s, buffers, loop_count);
+  }
+  return out;
+}
+
+unsigned long long gapcm_session_decode_buffer_for(struct GaPcmSession *s,
+                                                   struct GaPcmBuffers *buffers,
+                                                   const uint32_t count) {
+  return gapcm_decode_context_buffer(s, buffers, count * s->CHANNEL_COUNT);
+}
+
+unsigned long long
+gapcm_session_decode_buffer_loop(struct GaPcmSession *s,
+                                 struct GaPcmBuffers *buffers,
+                                 const int loop_count) {
+  return gapcm_decode_context_buffer_loop(s, buffers, loop_count);
+}
+
+unsigned long long gapcm_session_decode_io(struct GaPcmSession *s,
+                                           const struct GaPcmIo *source,
+                                           const struct GaPcmIo *output,
+                                           const int loop_count) {
+  return gapcm_session_run(s, source, output, GAPCM_RUN_DECODE, 0, loop_count);
+}
+
+unsigned long long gapcm_session_decode_io_for(struct GaPcmSession *s,
+                                               const struct GaPcmIo *source,
+                                               const struct GaPcmIo *output,
+                                               const uint32_t count) {
+  return gapcm_session_run(s, source, output, GAPCM_RUN_DECODE_FOR,
+                           count * s->CHANNEL_COUNT, 0);
+}
+
+unsigned long long gapcm_session_decode_io_loop(struct GaPcmSession *s,
+                                                const struct GaPcmIo *source,
+                                                const struct GaPcmIo *output,
+                                                const int loop_count) {
+  return gapcm_session_run(s, source, output, GAPCM_RUN_DECODE_LOOP, 0,
+                           loop_count);
+}
+
+unsigned long long gapcm_session_decode_loop(struct GaPcmSession *s,
+                                             FILE *restrict source,
+                                             FILE *restrict output,
+                                             const int loop_count) {
+  struct GaPcmIo ios[2];
+  return gapcm_session_decode_io_loop(s, gapcm_io_file(&ios[0], source),
+                                      gapcm_io_file(&ios[1], output),
+                                      loop_count);
+}
+
+unsigned long long gapcm_session_decode_parallel(
+    struct GaPcmSession *s, const struct GaPcmIoMemory *source,
+    const struct GaPcmSegment *segments, const size_t segment_count,
+    const int output, const unsigned long long offset,
+    const unsigned thread_count) {
+#ifdef _WIN32
+  errno = ENOSYS;
+  return 0;
+#else
+  if (s->CHANNEL_COUNT <= 0 || segment_count <= 0) {
+    return 0;
+  }
+  struct GaPcmParallel p = {
+      .header = s->header,
+      .source = source,
+      .segments = segments,
+      .groups = malloc(sizeof(*p.groups) * (segment_count + 1)),
+      .offsets = malloc(sizeof(*p.offsets) * segment_count),
+      .counts = {GAPCM_SECTOR_BYTES * s->CHANNEL_COUNT,
+                 GAPCM_BLOCK_BYTES * s->CHANNEL_COUNT},
+      .output = output,
+      .run = GAPCM_RUN_DECODE_FOR};
+  atomic_init(&p.group, 0);
+  atomic_init(&p.write_count, 0);
+  atomic_init(&p.error, 0);
+  if (p.groups == NULL || p.offsets == NULL) {
+    gapcm_parallel_fail(&p, ENOMEM);
+  } else {
+    gapcm_parallel_plan(&p, s, offset, segment_count);
+  }
+  unsigned long long out = gapcm_parallel_start(&p, thread_count);
+  free(p.offsets);
+  free(p.groups);
+  return out;
+#endif
+}
+
+unsigned long long gapcm_session_decode_stream(struct GaPcmSession *s,
+                                               FILE *restrict source,
+                                               FILE *restrict output,
+                                               const int loop_count) {
+  struct GaPcmIo ios[2];
+  return gapcm_session_decode_io(s, gapcm_io_file(&ios[0], source),
+                                 gapcm_io_file(&ios[1], output), loop_count);
+}
+
+unsigned long long gapcm_session_decode_stream_for(struct GaPcmSession *s,
+                                                   FILE *restrict source,
+                                                   FILE *restrict output,
+                                                   const uint32_t count) {
+  struct GaPcmIo ios[2];
+  return gapcm_session_decode_io_for(s, gapcm_io_file(&ios[0], source),
+                                     gapcm_io_file(&ios[1], output), count);
+}
+
+unsigned long long gapcm_session_encode_buffer(struct GaPcmSession *s,
+                                               struct GaPcmBuffers *buffers) {
+  return gapcm_session_encode_buffer_for(s, buffers, s->header->length);
+}
+
+unsigned long long gapcm_session_encode_buffer_for(struct GaPcmSession *s,
+                                                   struct GaPcmBuffers *buffers,
+                                                   const uint32_t count) {
+  return gapcm_encode_context_buffer(s, buffers, count * s->CHANNEL_COUNT);
+}
+
+unsigned long long gapcm_session_encode_io(struct GaPcmSession *s,
+                                           const struct GaPcmIo *source,
+                                           const struct GaPcmIo *output) {
+  return gapcm_session_encode_io_for(s, source, output, s->header->length);
+}
+
+unsigned long long gapcm_session_encode_io_for(struct GaPcmSession *s,
+                                               const struct GaPcmIo *source,
+                                               const struct GaPcmIo *output,
+                                               const uint32_t count) {
+  return gapcm_session_run(s, source, output, GAPCM_RUN_ENCODE_FOR,
+                           count * s->CHANNEL_COUNT, 0);
+}
+
+unsigned long long gapcm_session_encode_parallel(
+    struct GaPcmSession *s, const struct GaPcmIoMemory *source,
+    const int output, const unsigned long long offset, const uint32_t count,
+    const unsigned thread_count) {
+#ifdef _WIN32
+  errno = ENOSYS;
+  return 0;
+#else
+  if (s->CHANNEL_COUNT <= 0) {
+    return 0;
+  }
+  struct GaPcmSegment segment = {source->position,
+                                 (unsigned long long)count * s->CHANNEL_COUNT};
+  unsigned long long groups[2] = {0, 0};
+  unsigned long long offsets[1] = {offset};
+  struct GaPcmParallel p = {.header = s->header,
+                            .source = source,
+                            .segments = &segment,
+                            .groups = groups,
+                            .offsets = offsets,
+                            .counts = {GAPCM_BLOCK_BYTES * s->CHANNEL_COUNT,
+                                       GAPCM_SECTOR_BYTES * s->CHANNEL_COUNT},
+                            .segment_count = 1,
+                            .output = output,
+                            .run = GAPCM_RUN_ENCODE_FOR};
+  atomic_init(&p.group, 0);
+  atomic_init(&p.write_count, 0);
+  atomic_init(&p.error, 0);
+  unsigned long long count_left = segment.position < source->count
+                                      ? source->count - segment.position
+                                      : 0;
+  groups[1] = segment.count / p.counts[0];
+  if (groups[1] > count_left / p.counts[0]) {
+    groups[1] = count_left / p.counts[0];
+  }
+  // The tail pads its last block, and is written through the descriptor
+  // first, since it may take more than a group where samples span two bytes.
+  struct GaPcmIoMemory memory = *source;
+  memory.position = segment.position + p.counts[0] * groups[1];
+  struct GaPcmIo ios[2];
+  errno = 0;
+  if (lseek(output, offset + p.counts[1] * groups[1], SEEK_SET) < 0) {
+    gapcm_parallel_fail(&p, errno);
+  } else {
+    atomic_init(&p.write_count,
+                gapcm_session_run_serial(
+                    gapcm_session_open(s, gapcm_io_memory(&ios[0], &memory),
+                                       gapcm_io_fd(&ios[1], output)),
+                    GAPCM_RUN_ENCODE_FOR,
+                    segment.count - p.counts[0] * groups[1], 0));
+    if (errno != 0) {
+      gapcm_parallel_fail(&p, errno);
+    }
+  }
+  return gapcm_parallel_start(&p, thread_count);
+#endif
+}
+
+unsigned long long gapcm_session_encode_stream(struct GaPcmSession *s,
+                                               FILE *restrict source,
+                                               FILE *restrict output) {
+  return gapcm_session_encode_stream_for(s, source, output, s->header->length);
+}
+
+unsigned long long gapcm_session_encode_stream_for(struct GaPcmSession *s,
+                                                   FILE *restrict source,
+                                                   FILE *restrict output,
+                                                   const uint32_t count) {
+  struct GaPcmIo ios[2];
+  return gapcm_session_encode_io_for(s, gapcm_io_file(&ios[0], source),
+                                     gapcm_io_file(&ios[1], output), count);
+}
+
+struct GaPcmSession *gapcm_session_free(struct GaPcmSession *s) {
+  if (s != NULL) {
+    free(s->memory);
+  }
+  return NULL;
+}
+
+struct GaPcmSession *gapcm_session_make(const struct GaPcmHeader *header) {
+  size_t size = gapcm_session_bytes(header);
+  uint8_t *memory = malloc(size);
+  if (memory == NULL) {
+    return NULL;
+  }
+  struct GaPcmSession *out = gapcm_session_make_at(header, memory, size);
+  out->memory = memory;
+  return out;
+}
+
+struct GaPcmSession *gapcm_session_make_at(const struct GaPcmHeader *header,
+                                           void *memory, const size_t size) {
+  if (memory == NULL || size < gapcm_session_bytes(header)) {
+    return NULL;
+  }
+  struct GaPcmSession *out =
+      (struct GaPcmSession *)gapcm_session_align(memory);
+  out->CHANNEL_CAPACITY = gapcm_to_channelcount(header->format);
+  out->cache = 0;
+  out->memory = NULL;
+  out->sector = gapcm_session_align((uint8_t *)&out[1]);
+  out->blocks = &out->sector[GAPCM_SECTOR_BYTES];
+  out->frames = &out->blocks[GAPCM_BLOCK_BYTES * out->CHANNEL_CAPACITY];
+  out->pipeline = false;
+  gapcm_session_open(out, NULL, NULL);
+  gapcm_session_bind(out, header);
+  return out;
+}
+
+bool gapcm_session_pipeline(struct GaPcmSession *s, const bool pipeline) {
+#ifdef _WIN32
+  s->pipeline = false;
+#else
+  s->pipeline = pipeline;
+#endif
+  return s->pipeline;
+}
+
 uint16_t gapcm_to_channelcount(const uint16_t format) {
   switch (format) {
   case GAPCM_FORMAT_MONO:
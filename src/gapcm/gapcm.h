@@ -6,6 +6,8 @@
  * seek--for either looping or `gapcm_decode_seek` otherwise--set `errno` on
  * error. For PCM transcodes from and to signed 8-bit, set `GAPCM_SAMPLE_ORIGIN`
  * to `0`, `0x80` for unsigned. Consumer PCM refers to PCM of this format.
+ * Session functions ending with `_io` do the same on the callbacks of
+ * `GaPcmIo` instead of files.
  *
  * In a game PCM file, each 8-bit sample is preceded by eight padding bits.
  * GAPCM can use the latter to double the sample resolution while retaining
@@ -24,7 +26,9 @@
 /** Consumer PCM sample origin. */
 #define GAPCM_SAMPLE_ORIGIN 0x80
 
+#include "io.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -32,6 +36,16 @@
 #define GAPCM_BLOCK_BYTES (GAPCM_SAMPLE_BYTES * 1024)
 /** Block size in samples. */
 #define GAPCM_BLOCK_SAMPLES (GAPCM_BLOCK_BYTES / GAPCM_SAMPLE_BYTES)
+/**
+ * Suggested loop cache capacity in memory in bytes. See `gapcm_session_cache`.
+ */
+#define GAPCM_LOOP_CACHE_BYTES (64 * 1024 * 1024)
+/**
+ * Loop count for looping until the output fails. Loops stream in constant
+ * memory: decoded again from the mark, or replayed from the loop cache of a
+ * session that has one.
+ */
+#define GAPCM_LOOP_FOREVER -1
 /** Mono stream format. */
 #define GAPCM_FORMAT_MONO 2
 /** Stereo stream format. */
@@ -42,6 +56,8 @@
 #define GAPCM_SAMPLE_BYTES_PAD (2 - GAPCM_SAMPLE_BYTES)
 /** Sector size in bytes. */
 #define GAPCM_SECTOR_BYTES 2048
+/** Count of bytes that holds a session for any header. */
+#define GAPCM_SESSION_BYTES (GAPCM_SECTOR_BYTES + 4 * GAPCM_BLOCK_BYTES + 256)
 /** Count of blocks in a sector. */
 #define GAPCM_SECTOR_BLOCKS (GAPCM_SECTOR_BYTES / GAPCM_BLOCK_BYTES)
 
@@ -52,6 +68,52 @@
 #define GAPCM_ERROR_MARK                                                       \
   "The loop start position is more than the logical maximum."
 
+/** Pull decoder phases in their order. Loops repeat as needed. */
+enum GaPcmDecoderPhase {
+  /** Artificial silence. */
+  GAPCM_PHASE_PREGAP,
+  /** Stream start to the mark. */
+  GAPCM_PHASE_INTRO,
+  /** Mark to loop end. */
+  GAPCM_PHASE_LOOP,
+  /** Mark or loop end to stream end. */
+  GAPCM_PHASE_TRAIL,
+  /** Nothing left. */
+  GAPCM_PHASE_DONE
+};
+
+/**
+ * Represents a pull decoder. It decodes a stream on demand, a sector of each
+ * channel at a time, through the phases of `GaPcmDecoderPhase`.
+ */
+struct GaPcmDecoder;
+
+/**
+ * Represents a transcoding session. It holds the buffers needed to transcode
+ * streams of a header, and can be reused across calls to spare the allocations
+ * that the sessionless functions otherwise make on the stack. Sessions are not
+ * thread-safe.
+ */
+struct GaPcmSession;
+
+/**
+ * Represents the buffers of a buffer transcode. Transcodes advance each by the
+ * count of bytes consumed or produced, and stop early rather than split a
+ * sector or a block when either runs short, so they can be resumed with more.
+ */
+struct GaPcmBuffers {
+  /** Source bytes. */
+  const uint8_t *source;
+  /** Output bytes. */
+  uint8_t *output;
+  /** Count of source bytes. */
+  size_t source_count;
+  /** Count of output bytes. */
+  size_t output_count;
+  /** Source ends with these bytes? Then a short tail is transcoded as well. */
+  bool source_end;
+};
+
 /**
  * Represents a GAPCM header. A block spans 1024 samples, a frame spans one
  * sample for mono, two for stereo, and a tick spans 7.8 ms.
@@ -75,6 +137,58 @@ struct GaPcmHeader {
   uint8_t pregap;
 };
 
+/**
+ * Represents a decode segment: a run from a source position for a count of
+ * output bytes, as by `gapcm_session_decode_io_for` after seeking there.
+ */
+struct GaPcmSegment {
+  /** Source position in bytes. */
+  unsigned long long position;
+  /** Count of output bytes. */
+  unsigned long long count;
+};
+
+/** Represents the kind of a part of a render plan. */
+enum GaPcmPartKind {
+  /** Origin samples. */
+  GAPCM_PART_SILENCE,
+  /** Decoded from the source. */
+  GAPCM_PART_SOURCE,
+  /** Copies of the output of the part before, which may be reused. */
+  GAPCM_PART_REPEAT
+};
+
+/** Represents a part of a render plan. */
+struct GaPcmPart {
+  /**
+   * Decode segment. The position is unused for silence, and is that of the
+   * part before for repeats, which decode alike.
+   */
+  struct GaPcmSegment segment;
+  /** Output offset in bytes. */
+  unsigned long long offset;
+  /** Kind. */
+  enum GaPcmPartKind kind;
+};
+
+/** Count of parts at most in a render plan. */
+#define GAPCM_PLAN_PARTS 6
+
+/**
+ * Represents a render plan: the parts of the output of a decode in order, from
+ * the pregap through the intro, the loops, and the trail.
+ */
+struct GaPcmPlan {
+  /** Parts. */
+  struct GaPcmPart parts[GAPCM_PLAN_PARTS];
+  /** Count of parts. */
+  size_t part_count;
+  /** Count of output bytes. */
+  unsigned long long count;
+  /** Source holds every part but the trail in whole? */
+  bool whole;
+};
+
 /** Game PCM origin 16-bit sample in little-endian order. */
 extern const unsigned char gapcm_origin[];
 
@@ -87,11 +201,29 @@ extern const unsigned char gapcm_sample_origin[];
  */
 size_t gapcm_decode_header(uint8_t *sector, struct GaPcmHeader *header);
 
-/** Decodes the given loop defined by the given header to the given output. */
+/**
+ * Decodes the given loop defined by the given header to the given output. See
+ * `GAPCM_LOOP_FOREVER`. Each loop is decoded again from the mark without
+ * allocating; see `gapcm_session_cache` to replay loops from a cache instead.
+ */
 unsigned long long gapcm_decode_loop(const struct GaPcmHeader *header,
                                      FILE *source, FILE *output,
                                      int loop_count);
 
+/**
+ * Plans the decode of a stream of the given header from a source of the given
+ * count of bytes, header sector included, to the given plan and returns its
+ * count of output bytes. It is the pregap, the stream up to the mark, then the
+ * given count of loops like `gapcm_decode_stream`. With `trail`, the last loop
+ * continues to the stream end instead, like the decoder application. Parts of
+ * a short source are cut as decoding would, and the plan ends at the first.
+ * Loop counts below zero plan no loops.
+ */
+unsigned long long gapcm_decode_plan(const struct GaPcmHeader *header,
+                                     unsigned long long source_count,
+                                     int loop_count, bool trail,
+                                     struct GaPcmPlan *plan);
+
 /** Writes the given count of silent blocks to the given file. */
 unsigned long long gapcm_decode_pregap(const uint8_t pregap, FILE *file);
 
@@ -127,6 +259,46 @@ unsigned long long gapcm_decode_stream_for(const struct GaPcmHeader *header,
                                            FILE *source, FILE *output,
                                            uint32_t count);
 
+/** Frees the given pull decoder. Its session is left as is. */
+struct GaPcmDecoder *gapcm_decoder_free(struct GaPcmDecoder *decoder);
+
+/**
+ * Makes a pull decoder from the given source with the given session, which it
+ * uses until freed. It plays the pregap, the stream up to the mark, then the
+ * given count of loops like `gapcm_decode_stream`. With `trail`, the last loop
+ * continues to the stream end instead. Returns NULL on allocation failure.
+ */
+struct GaPcmDecoder *gapcm_decoder_make(struct GaPcmSession *session,
+                                        FILE *source, int loop_count,
+                                        bool trail);
+
+/** See `gapcm_decoder_make`. */
+struct GaPcmDecoder *gapcm_decoder_make_io(struct GaPcmSession *session,
+                                           const struct GaPcmIo *source,
+                                           int loop_count, bool trail);
+
+/**
+ * Decodes up to the given count of frames with the given pull decoder to the
+ * given location and returns the count of bytes there. The location points
+ * into the decoder and is valid until the next call. Returns zero when done or
+ * on error, then look into the source for the latter.
+ */
+size_t gapcm_decoder_next(struct GaPcmDecoder *decoder, uint32_t count,
+                          const uint8_t **frames);
+
+/** Returns the phase of the most recent frames of the given pull decoder. */
+enum GaPcmDecoderPhase gapcm_decoder_phase(const struct GaPcmDecoder *decoder);
+
+/**
+ * Seeks the given pull decoder to the given frame of its output, counting from
+ * the pregap through the loops and the trail, and returns its success. The
+ * source position is computed and sought directly, so only the sector of each
+ * channel holding the frame is decoded. Fails past the output end or if the
+ * source cannot seek, then the decoder is done.
+ */
+bool gapcm_decoder_seek(struct GaPcmDecoder *decoder,
+                        unsigned long long frame);
+
 /**
  * Encodes the given header to the given sector and returns `GAPCM_SECTOR_BYTES`
  * on success.
@@ -169,6 +341,169 @@ struct GaPcmHeader *gapcm_header_make(void);
  */
 int gapcm_header_stringify(const struct GaPcmHeader *header, char *string);
 
+/**
+ * Binds the given header to the given session and returns its success. It
+ * fails if the header has more channels than the session was made for.
+ */
+bool gapcm_session_bind(struct GaPcmSession *session,
+                        const struct GaPcmHeader *header);
+
+/**
+ * Returns the count of bytes needed to make a session for the given header in
+ * caller-owned memory. See `GAPCM_SESSION_BYTES` for any header.
+ */
+size_t gapcm_session_bytes(const struct GaPcmHeader *header);
+
+/**
+ * Sets the capacity in memory of the loop cache of the given session in bytes
+ * and returns it. Loops after the first from the mark are then replayed from
+ * the cache where the source can tell its position, and longer loops are
+ * cached in a mapped temporary file. Default is `0` for no cache, so sessions
+ * do not allocate. See `GAPCM_LOOP_CACHE_BYTES`.
+ */
+size_t gapcm_session_cache(struct GaPcmSession *session, size_t capacity);
+
+/**
+ * Decodes the given buffers as a stream defined by the header of the given
+ * session. See `gapcm_decode_stream`. Loops restart from the source position
+ * at the loop start. See `GaPcmBuffers`.
+ */
+unsigned long long gapcm_session_decode_buffer(struct GaPcmSession *session,
+                                               struct GaPcmBuffers *buffers,
+                                               int loop_count);
+
+/** See `gapcm_session_decode_buffer` and `gapcm_decode_stream_for`. */
+unsigned long long gapcm_session_decode_buffer_for(struct GaPcmSession *session,
+                                                   struct GaPcmBuffers *buffers,
+                                                   uint32_t count);
+
+/**
+ * See `gapcm_session_decode_buffer` and `gapcm_decode_loop`. Loops restart from
+ * the source position at the call.
+ */
+unsigned long long
+gapcm_session_decode_buffer_loop(struct GaPcmSession *session,
+                                 struct GaPcmBuffers *buffers, int loop_count);
+
+/** See `gapcm_session_decode_stream`. */
+unsigned long long gapcm_session_decode_io(struct GaPcmSession *session,
+                                           const struct GaPcmIo *source,
+                                           const struct GaPcmIo *output,
+                                           int loop_count);
+
+/** See `gapcm_session_decode_stream_for`. */
+unsigned long long gapcm_session_decode_io_for(struct GaPcmSession *session,
+                                               const struct GaPcmIo *source,
+                                               const struct GaPcmIo *output,
+                                               uint32_t count);
+
+/** See `gapcm_session_decode_loop`. */
+unsigned long long gapcm_session_decode_io_loop(struct GaPcmSession *session,
+                                                const struct GaPcmIo *source,
+                                                const struct GaPcmIo *output,
+                                                int loop_count);
+
+/** See `gapcm_decode_loop`. */
+unsigned long long gapcm_session_decode_loop(struct GaPcmSession *session,
+                                             FILE *source, FILE *output,
+                                             int loop_count);
+
+/**
+ * Decodes the given count of segments from the given memory source to the given
+ * file descriptor from the given offset with positional writes, and returns the
+ * count of bytes written. Whole sectors are split across the given count of
+ * threads, `0` for one per processor, and each segment tail is decoded by the
+ * calling thread. Stops after the first segment that falls short, as
+ * consecutive serial decodes would, and outputs match theirs. Sets `errno` on
+ * failure. Unsupported on Windows.
+ */
+unsigned long long gapcm_session_decode_parallel(
+    struct GaPcmSession *session, const struct GaPcmIoMemory *source,
+    const struct GaPcmSegment *segments, size_t segment_count, int output,
+    unsigned long long offset, unsigned thread_count);
+
+/** See `gapcm_decode_stream`. */
+unsigned long long gapcm_session_decode_stream(struct GaPcmSession *session,
+                                               FILE *source, FILE *output,
+                                               int loop_count);
+
+/** See `gapcm_decode_stream_for`. */
+unsigned long long gapcm_session_decode_stream_for(struct GaPcmSession *session,
+                                                   FILE *source, FILE *output,
+                                                   uint32_t count);
+
+/**
+ * Encodes the given buffers as a stream defined by the header of the given
+ * session. See `gapcm_encode_stream` and `GaPcmBuffers`.
+ */
+unsigned long long gapcm_session_encode_buffer(struct GaPcmSession *session,
+                                               struct GaPcmBuffers *buffers);
+
+/** See `gapcm_session_encode_buffer` and `gapcm_encode_stream_for`. */
+unsigned long long gapcm_session_encode_buffer_for(struct GaPcmSession *session,
+                                                   struct GaPcmBuffers *buffers,
+                                                   uint32_t count);
+
+/** See `gapcm_session_encode_stream`. */
+unsigned long long gapcm_session_encode_io(struct GaPcmSession *session,
+                                           const struct GaPcmIo *source,
+                                           const struct GaPcmIo *output);
+
+/** See `gapcm_session_encode_stream_for`. */
+unsigned long long gapcm_session_encode_io_for(struct GaPcmSession *session,
+                                               const struct GaPcmIo *source,
+                                               const struct GaPcmIo *output,
+                                               uint32_t count);
+
+/**
+ * Encodes the given count of samples from the given memory source at its
+ * position like `gapcm_session_encode_io_for` to the given file descriptor from
+ * the given offset with positional writes, and returns the count of bytes
+ * written. Whole blocks are split across the given count of threads, `0` for
+ * one per processor, after the calling thread encodes the padded tail. Outputs
+ * match those of serial encodes. Sets `errno` on failure. Unsupported on
+ * Windows.
+ */
+unsigned long long gapcm_session_encode_parallel(
+    struct GaPcmSession *session, const struct GaPcmIoMemory *source,
+    int output, unsigned long long offset, uint32_t count,
+    unsigned thread_count);
+
+/** See `gapcm_encode_stream`. */
+unsigned long long gapcm_session_encode_stream(struct GaPcmSession *session,
+                                               FILE *source, FILE *output);
+
+/** See `gapcm_encode_stream_for`. */
+unsigned long long gapcm_session_encode_stream_for(struct GaPcmSession *session,
+                                                   FILE *source, FILE *output,
+                                                   uint32_t count);
+
+/** Frees the given session. Caller-owned memory is left as is. */
+struct GaPcmSession *gapcm_session_free(struct GaPcmSession *session);
+
+/**
+ * Makes a session for the given header in one allocation. Returns NULL on
+ * allocation failure.
+ */
+struct GaPcmSession *gapcm_session_make(const struct GaPcmHeader *header);
+
+/**
+ * Makes a session for the given header in the given caller-owned memory of the
+ * given size. Returns NULL if the memory is too small. Buffers are aligned
+ * within the memory, so it needs no particular alignment.
+ */
+struct GaPcmSession *gapcm_session_make_at(const struct GaPcmHeader *header,
+                                           void *memory, size_t size);
+
+/**
+ * Sets whether the given session runs its `_io` and stream transcodes in a
+ * pipeline and returns whether it does. There, the source is read ahead by one
+ * thread and the output written by another, each connected to the calling
+ * thread transcoding by a bounded ring. Outputs, counts, and `errno` on error
+ * match those without. Unsupported on Windows.
+ */
+bool gapcm_session_pipeline(struct GaPcmSession *session, bool pipeline);
+
 /** Translates the given stream format to channel count. */
 uint16_t gapcm_to_channelcount(uint16_t format);
 
@@ -0,0 +1,858 @@
+/**
+ * Undo setting of `errno` to `EBADF` on `fflush`. Flushing input streams is
+ * undefined on older POSIX systems where `EBADF` may be set. This is defined by
+ * default for compatibility and should be undefined for debugging.
+ */
+#define GAPCM_FFLUSH_EBADF
+
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "io.h"
+#include "gapcm.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define GAPCM_SUCCESS 0
+/** Requested pipe size in bytes. */
+#define GAPCM_IO_PIPE_BYTES (1 << 20)
+/** Repeat buffer size in bytes where bytes are not copied by the kernel. */
+#define GAPCM_IO_REPEAT_BYTES (1 << 20)
+/** io_uring adapter buffer count. */
+#define GAPCM_IO_URING_BUFFERS 16
+/** io_uring adapter buffer size in bytes: whole sectors and blocks alike. */
+#define GAPCM_IO_URING_BUFFER_BYTES (8 * GAPCM_SECTOR_BYTES)
+/** Largest sector-aligned offset that one `fseek` takes. */
+#define GAPCM_IO_OFFSET_MAXIMUM                                                \
+  (LONG_MAX / GAPCM_SECTOR_BYTES * GAPCM_SECTOR_BYTES)
+
+#ifdef __linux__
+/**
+ * Represents a pipe for the pipe adapter. Each buffer is as large as the pipe,
+ * so a buffer that was spliced whole leaves none of the other in the pipe for
+ * it to be reused. They are mapped rather than allocated, as the pipe keeps
+ * their pages past unmapping but not past reuse by the allocator.
+ */
+struct GaPcmIoPipe {
+  /** Page-aligned buffers. */
+  uint8_t *buffers[2];
+  /** Count of bytes in each buffer. */
+  size_t capacity;
+  /** Count of bytes in the current buffer. */
+  size_t count;
+  /** Index to the current buffer. */
+  size_t index;
+  /** File descriptor. */
+  int fd;
+  /** Splice buffers? Otherwise write them. */
+  bool splice;
+};
+
+/** Represents a buffer of the io_uring adapter. */
+struct GaPcmIoUringBuffer {
+  /** Bytes. Registered with the ring. */
+  uint8_t *bytes;
+  /** Count of bytes to transfer. */
+  size_t count;
+  /** Count of bytes transferred, or negated `errno`. */
+  int result;
+  /** In flight? */
+  bool pending;
+};
+
+/**
+ * Represents an io_uring stream for the io_uring adapter. Buffers are taken in
+ * turn: a source submits reads ahead of those consumed, and an output submits
+ * each buffer once filled.
+ */
+struct GaPcmIoUring {
+  /** Buffers. */
+  struct GaPcmIoUringBuffer buffers[GAPCM_IO_URING_BUFFERS];
+  /** Mappings of the submission ring, completion ring, and entries. */
+  void *maps[3];
+  /** Counts of bytes of the mappings. */
+  size_t map_counts[3];
+  /** Submission queue entries. */
+  struct io_uring_sqe *sqes;
+  /** Completion queue entries. */
+  struct io_uring_cqe *cqes;
+  /** Submission queue indices. */
+  unsigned *sq_array;
+  /** Submission queue tail. */
+  unsigned *sq_tail;
+  /** Completion queue head. */
+  unsigned *cq_head;
+  /** Completion queue tail. */
+  unsigned *cq_tail;
+  /** Offset of the next submitted transfer. */
+  unsigned long long offset;
+  /** Count of buffers consumed or filled. */
+  unsigned long long head;
+  /** Count of buffers submitted. */
+  unsigned long long tail;
+  /** Index to the next byte of the current buffer. */
+  size_t position;
+  /** Count of queued transfers not yet submitted. */
+  unsigned queue_count;
+  /** Submission queue index mask. */
+  unsigned sq_mask;
+  /** Completion queue index mask. */
+  unsigned cq_mask;
+  /** `errno` of the first failed write. */
+  int error;
+  /** File descriptor. */
+  int fd;
+  /** Ring file descriptor. */
+  int ring_fd;
+  /** Output? Otherwise source. */
+  bool output;
+  /** Source ended? */
+  bool end;
+};
+#endif
+
+#ifndef _WIN32
+/** Returns the file descriptor in the given user pointer. */
+static int gapcm_io_fd_of(void *user) { return (int)(intptr_t)user; }
+
+static void gapcm_io_fd_prefetch(void *user, const unsigned long long offset,
+                                 const size_t count) {
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise(gapcm_io_fd_of(user), (off_t)offset, (off_t)count,
+                POSIX_FADV_WILLNEED);
+#else
+  // Wunused-parameter
+  (void)user, (void)offset, (void)count;
+#endif
+}
+
+static size_t gapcm_io_fd_read(void *user, void *bytes, const size_t count) {
+  size_t out = 0;
+  while (out < count) {
+    ssize_t count_read =
+        read(gapcm_io_fd_of(user), (uint8_t *)bytes + out, count - out);
+    if (count_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count_read <= 0) {
+      break;
+    }
+    out += count_read;
+  }
+  return out;
+}
+
+static int gapcm_io_fd_seek(void *user, const unsigned long long offset) {
+  return lseek(gapcm_io_fd_of(user), (off_t)offset, SEEK_SET) < 0
+             ? -1
+             : GAPCM_SUCCESS;
+}
+
+static long long gapcm_io_fd_tell(void *user) {
+  return lseek(gapcm_io_fd_of(user), 0, SEEK_CUR);
+}
+
+static size_t gapcm_io_fd_write(void *user, const void *bytes,
+                                const size_t count) {
+  size_t out = 0;
+  while (out < count) {
+    ssize_t count_write =
+        write(gapcm_io_fd_of(user), (const uint8_t *)bytes + out, count - out);
+    if (count_write < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count_write <= 0) {
+      break;
+    }
+    out += count_write;
+  }
+  return out;
+}
+#endif
+
+#ifndef _WIN32
+static void gapcm_io_file_prefetch(void *user, const unsigned long long offset,
+                                   const size_t count) {
+  gapcm_io_fd_prefetch((void *)(intptr_t)fileno(user), offset, count);
+}
+#endif
+
+static size_t gapcm_io_file_read(void *user, void *bytes, const size_t count) {
+  return fread(bytes, 1, count, user);
+}
+
+static int gapcm_io_file_seek(void *user, unsigned long long offset) {
+  FILE *file = user;
+  int errnoo = errno;
+  int out = fflush(file);
+  if (out != GAPCM_SUCCESS) {
+#ifdef GAPCM_FFLUSH_EBADF
+    if (errno != EBADF) {
+      return out;
+    }
+    errno = errnoo;
+#else
+    return out;
+#endif
+  }
+#ifndef _WIN32
+  if (sizeof(off_t) >= sizeof(long long) && offset <= LLONG_MAX) {
+    return fseeko(file, (off_t)offset, SEEK_SET);
+  }
+#endif
+  int whence = SEEK_SET;
+  do {
+    long step = offset < GAPCM_IO_OFFSET_MAXIMUM ? (long)offset
+                                                 : GAPCM_IO_OFFSET_MAXIMUM;
+    out = fseek(file, step, whence);
+    if (out != GAPCM_SUCCESS) {
+      return out;
+    }
+    offset -= step;
+    whence = SEEK_CUR;
+  } while (offset > 0);
+  return out;
+}
+
+static long long gapcm_io_file_tell(void *user) {
+#ifdef _WIN32
+  return ftell(user);
+#else
+  return ftello(user);
+#endif
+}
+
+static size_t gapcm_io_file_write(void *user, const void *bytes,
+                                  const size_t count) {
+  return fwrite(bytes, 1, count, user);
+}
+
+#ifdef __linux__
+static size_t gapcm_io_pipe_write(void *user, const void *bytes,
+                                  const size_t count) {
+  struct GaPcmIoPipe *p = user;
+  size_t out = 0;
+  while (out < count) {
+    if (p->count == p->capacity && !gapcm_io_pipe_flush(p)) {
+      break;
+    }
+    size_t step = count - out < p->capacity - p->count
+                      ? count - out
+                      : p->capacity - p->count;
+    memcpy(&p->buffers[p->index][p->count], (const uint8_t *)bytes + out, step);
+    p->count += step;
+    out += step;
+  }
+  return out;
+}
+#endif
+
+#ifdef __linux__
+/**
+ * Queues a transfer of the given count of bytes of the given buffer of the
+ * given io_uring stream at its offset.
+ */
+static void gapcm_io_uring_queue(struct GaPcmIoUring *u, const size_t index,
+                                 const size_t count) {
+  unsigned tail = *u->sq_tail;
+  struct io_uring_sqe *sqe = &u->sqes[tail & u->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = u->output ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+  sqe->fd = u->fd;
+  sqe->addr = (uintptr_t)u->buffers[index].bytes;
+  sqe->len = count;
+  sqe->off = u->offset;
+  sqe->buf_index = index;
+  sqe->user_data = index;
+  u->sq_array[tail & u->sq_mask] = tail & u->sq_mask;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  u->buffers[index].count = count;
+  u->buffers[index].pending = true;
+  u->offset += count;
+  u->queue_count++;
+}
+
+/**
+ * Submits the queued transfers of the given io_uring stream and reaps its
+ * completions until the given buffer, if any, is no longer in flight. Returns
+ * its success.
+ */
+static bool gapcm_io_uring_reap(struct GaPcmIoUring *u,
+                                const struct GaPcmIoUringBuffer *buffer) {
+  while (true) {
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+      u->buffers[cqe->user_data].result = cqe->res;
+      u->buffers[cqe->user_data].pending = false;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    bool wait = buffer != NULL && buffer->pending;
+    if (u->queue_count == 0 && !wait) {
+      return true;
+    }
+    long count = syscall(__NR_io_uring_enter, u->ring_fd, u->queue_count,
+                         wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL,
+                         0);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    u->queue_count -= count;
+  }
+}
+
+/**
+ * Waits for the given buffer of the given io_uring stream and returns its
+ * success. A failed write sets the stream error once.
+ */
+static bool gapcm_io_uring_settle(struct GaPcmIoUring *u,
+                                  struct GaPcmIoUringBuffer *b) {
+  if (!gapcm_io_uring_reap(u, b)) {
+    if (u->error == 0) {
+      u->error = errno;
+    }
+    return false;
+  }
+  if (u->output && b->count > 0) {
+    if (b->result != (int)b->count && u->error == 0) {
+      u->error = b->result < 0 ? -b->result : EIO;
+    }
+    b->count = 0;
+  }
+  return u->error == 0;
+}
+
+static void gapcm_io_uring_prefetch(void *user,
+                                    const unsigned long long offset,
+                                    const size_t count) {
+  gapcm_io_fd_prefetch((void *)(intptr_t)((struct GaPcmIoUring *)user)->fd,
+                       offset, count);
+}
+
+static size_t gapcm_io_uring_read(void *user, void *bytes, const size_t count) {
+  struct GaPcmIoUring *u = user;
+  size_t out = 0;
+  while (out < count) {
+    while (!u->end && u->tail - u->head < GAPCM_IO_URING_BUFFERS) {
+      gapcm_io_uring_queue(u, u->tail++ % GAPCM_IO_URING_BUFFERS,
+                           GAPCM_IO_URING_BUFFER_BYTES);
+    }
+    if (u->head == u->tail) {
+      break;
+    }
+    struct GaPcmIoUringBuffer *b =
+        &u->buffers[u->head % GAPCM_IO_URING_BUFFERS];
+    if (!gapcm_io_uring_reap(u, b)) {
+      break;
+    }
+    if (b->result < 0) {
+      errno = -b->result;
+      break;
+    }
+    size_t step = count - out < b->result - u->position
+                      ? count - out
+                      : b->result - u->position;
+    memcpy((uint8_t *)bytes + out, &b->bytes[u->position], step);
+    out += step;
+    u->position += step;
+    if (u->position == (size_t)b->result) {
+      u->head++;
+      u->position = 0;
+      if ((size_t)b->result < b->count) {
+        u->end = true;
+        break;
+      }
+    }
+  }
+  return out;
+}
+
+static int gapcm_io_uring_seek(void *user, const unsigned long long offset) {
+  struct GaPcmIoUring *u = user;
+  for (; u->head != u->tail; u->head++) {
+    if (!gapcm_io_uring_reap(u,
+                             &u->buffers[u->head % GAPCM_IO_URING_BUFFERS])) {
+      return -1;
+    }
+  }
+  u->offset = offset;
+  u->position = 0;
+  u->end = false;
+  return GAPCM_SUCCESS;
+}
+
+static long long gapcm_io_uring_tell(void *user) {
+  struct GaPcmIoUring *u = user;
+  if (u->output) {
+    return u->offset + u->position;
+  }
+  unsigned long long out = u->offset;
+  for (unsigned long long index = u->head; index != u->tail; index++) {
+    out -= u->buffers[index % GAPCM_IO_URING_BUFFERS].count;
+  }
+  return out + u->position;
+}
+
+static size_t gapcm_io_uring_write(void *user, const void *bytes,
+                                   const size_t count) {
+  struct GaPcmIoUring *u = user;
+  size_t out = 0;
+  while (out < count) {
+    size_t index = u->tail % GAPCM_IO_URING_BUFFERS;
+    struct GaPcmIoUringBuffer *b = &u->buffers[index];
+    if (!gapcm_io_uring_settle(u, b)) {
+      errno = u->error;
+      break;
+    }
+    size_t step = count - out < GAPCM_IO_URING_BUFFER_BYTES - u->position
+                      ? count - out
+                      : GAPCM_IO_URING_BUFFER_BYTES - u->position;
+    memcpy(&b->bytes[u->position], (const uint8_t *)bytes + out, step);
+    out += step;
+    u->position += step;
+    if (u->position == GAPCM_IO_URING_BUFFER_BYTES) {
+      gapcm_io_uring_queue(u, index, u->position);
+      u->tail++;
+      u->position = 0;
+      gapcm_io_uring_reap(u, NULL);
+    }
+  }
+  return out;
+}
+#endif
+
+#ifndef _WIN32
+static void gapcm_io_memory_prefetch(void *user,
+                                     const unsigned long long offset,
+                                     size_t count) {
+  struct GaPcmIoMemory *m = user;
+  if (m->bytes == NULL || offset >= m->count) {
+    return;
+  }
+  if (count > m->count - offset) {
+    count = m->count - offset;
+  }
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)&m->bytes[offset];
+  posix_madvise((void *)(start / page * page), start % page + count,
+                POSIX_MADV_WILLNEED);
+}
+#endif
+
+static size_t gapcm_io_memory_read(void *user, void *bytes, size_t count) {
+  struct GaPcmIoMemory *m = user;
+  if (count > m->count - m->position) {
+    count = m->count - m->position;
+  }
+  memcpy(bytes, &m->bytes[m->position], count);
+  m->position += count;
+  return count;
+}
+
+static int gapcm_io_memory_seek(void *user, const unsigned long long offset) {
+  struct GaPcmIoMemory *m = user;
+  if (offset > m->count) {
+    errno = EINVAL;
+    return -1;
+  }
+  m->position = offset;
+  return GAPCM_SUCCESS;
+}
+
+static long long gapcm_io_memory_tell(void *user) {
+  return ((struct GaPcmIoMemory *)user)->position;
+}
+
+static size_t gapcm_io_memory_write(void *user, const void *bytes,
+                                    size_t count) {
+  struct GaPcmIoMemory *m = user;
+  if (count > m->count - m->position) {
+    count = m->count - m->position;
+  }
+  memcpy(&m->bytes[m->position], bytes, count);
+  m->position += count;
+  return count;
+}
+
+#ifndef _WIN32
+struct GaPcmIo *gapcm_io_fd(struct GaPcmIo *io, const int fd) {
+  io->PREFETCH = gapcm_io_fd_prefetch;
+  io->READ = gapcm_io_fd_read;
+  io->SEEK = gapcm_io_fd_seek;
+  io->TELL = gapcm_io_fd_tell;
+  io->WRITE = gapcm_io_fd_write;
+  io->user = (void *)(intptr_t)fd;
+  return io;
+}
+
+unsigned long long gapcm_io_fd_repeat(const int fd, const long long offset,
+                                      const unsigned long long count,
+                                      const unsigned long long times) {
+  unsigned long long out = 0;
+  if (offset < 0 || count == 0 || (unsigned long long)offset < count) {
+    return out;
+  }
+  unsigned long long total = count * times;
+  uint8_t *buffer = NULL;
+  bool copy = true;
+  while (out < total) {
+    // Bytes written are repeated too, so each copy may double the last.
+    unsigned long long position = offset + out;
+    unsigned long long from = position - count * (1 + out / count);
+    unsigned long long count_copy = position - from;
+    if (count_copy > total - out) {
+      count_copy = total - out;
+    }
+#ifdef __linux__
+    if (copy) {
+      loff_t offset_from = from;
+      loff_t offset_to = position;
+      ssize_t count_write =
+          copy_file_range(fd, &offset_from, fd, &offset_to, count_copy, 0);
+      if (count_write < 0 && errno == EINTR) {
+        continue;
+      }
+      if (count_write > 0) {
+        out += count_write;
+        continue;
+      }
+      if (count_write == 0 || (errno != EINVAL && errno != ENOSYS &&
+                               errno != EOPNOTSUPP && errno != EXDEV)) {
+        break;
+      }
+    }
+#endif
+    copy = false;
+    if (buffer == NULL && (buffer = malloc(GAPCM_IO_REPEAT_BYTES)) == NULL) {
+      break;
+    }
+    if (count_copy > GAPCM_IO_REPEAT_BYTES) {
+      count_copy = GAPCM_IO_REPEAT_BYTES;
+    }
+    ssize_t count_read = pread(fd, buffer, count_copy, from);
+    if (count_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count_read <= 0) {
+      break;
+    }
+    ssize_t count_write = pwrite(fd, buffer, count_read, position);
+    if (count_write < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count_write <= 0) {
+      break;
+    }
+    out += count_write;
+  }
+  free(buffer);
+  return out;
+}
+#endif
+
+struct GaPcmIo *gapcm_io_file(struct GaPcmIo *io, FILE *file) {
+#ifdef _WIN32
+  io->PREFETCH = NULL;
+#else
+  io->PREFETCH = gapcm_io_file_prefetch;
+#endif
+  io->READ = gapcm_io_file_read;
+  io->SEEK = gapcm_io_file_seek;
+  io->TELL = gapcm_io_file_tell;
+  io->WRITE = gapcm_io_file_write;
+  io->user = file;
+  return io;
+}
+
+struct GaPcmIo *gapcm_io_memory(struct GaPcmIo *io,
+                                struct GaPcmIoMemory *memory) {
+#ifdef _WIN32
+  io->PREFETCH = NULL;
+#else
+  io->PREFETCH = gapcm_io_memory_prefetch;
+#endif
+  io->READ = gapcm_io_memory_read;
+  io->SEEK = gapcm_io_memory_seek;
+  io->TELL = gapcm_io_memory_tell;
+  io->WRITE = gapcm_io_memory_write;
+  io->user = memory;
+  return io;
+}
+
+#ifndef _WIN32
+bool gapcm_io_memory_map(struct GaPcmIoMemory *memory, const int fd) {
+  int errnoo = errno;
+  struct stat status;
+  if (fstat(fd, &status) != GAPCM_SUCCESS || !S_ISREG(status.st_mode) ||
+      status.st_size <= 0 || (uintmax_t)status.st_size > SIZE_MAX) {
+    errno = errnoo;
+    return false;
+  }
+  void *bytes = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (bytes == MAP_FAILED) {
+    errno = errnoo;
+    return false;
+  }
+  posix_madvise(bytes, status.st_size, POSIX_MADV_SEQUENTIAL);
+  posix_madvise(bytes, status.st_size, POSIX_MADV_WILLNEED);
+  memory->bytes = bytes;
+  memory->count = status.st_size;
+  memory->position = 0;
+  return true;
+}
+#endif
+
+struct GaPcmIoMemory *gapcm_io_memory_of(const struct GaPcmIo *io) {
+  return io->READ == gapcm_io_memory_read ? io->user : NULL;
+}
+
+#ifndef _WIN32
+void gapcm_io_memory_unmap(struct GaPcmIoMemory *memory) {
+  if (memory->bytes != NULL) {
+    munmap(memory->bytes, memory->count);
+  }
+  memory->bytes = NULL;
+  memory->count = 0;
+  memory->position = 0;
+}
+#endif
+
+#ifdef __linux__
+struct GaPcmIo *gapcm_io_pipe(struct GaPcmIo *io, struct GaPcmIoPipe *pipe) {
+  io->PREFETCH = NULL;
+  io->READ = NULL;
+  io->SEEK = NULL;
+  io->TELL = NULL;
+  io->WRITE = gapcm_io_pipe_write;
+  io->user = pipe;
+  return io;
+}
+
+bool gapcm_io_pipe_flush(struct GaPcmIoPipe *p) {
+  uint8_t *bytes = p->buffers[p->index];
+  size_t count = p->count;
+  while (count > 0) {
+    int errnoo = errno;
+    ssize_t count_write;
+    if (p->splice) {
+      struct iovec vector = {bytes, count};
+      count_write = vmsplice(p->fd, &vector, 1, 0);
+      if (count_write < 0 && (errno == EINVAL || errno == ENOSYS)) {
+        errno = errnoo;
+        p->splice = false;
+        continue;
+      }
+    } else {
+      count_write = write(p->fd, bytes, count);
+    }
+    if (count_write < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count_write <= 0) {
+      return false;
+    }
+    bytes += count_write;
+    count -= count_write;
+  }
+  p->count = 0;
+  p->index ^= 1;
+  return true;
+}
+
+struct GaPcmIoPipe *gapcm_io_pipe_free(struct GaPcmIoPipe *p) {
+  if (p != NULL) {
+    munmap(p->buffers[0], 2 * p->capacity);
+    free(p);
+  }
+  return NULL;
+}
+
+struct GaPcmIoPipe *gapcm_io_pipe_make(const int fd) {
+  int errnoo = errno;
+  struct stat status;
+  if (fstat(fd, &status) != GAPCM_SUCCESS || !S_ISFIFO(status.st_mode)) {
+    errno = errnoo;
+    return NULL;
+  }
+  fcntl(fd, F_SETPIPE_SZ, GAPCM_IO_PIPE_BYTES);
+  int capacity = fcntl(fd, F_GETPIPE_SZ);
+  long page = sysconf(_SC_PAGESIZE);
+  errno = errnoo;
+  if (capacity <= 0 || page <= 0 || capacity % page != 0) {
+    return NULL;
+  }
+  struct GaPcmIoPipe *out = malloc(sizeof(*out));
+  uint8_t *buffers = mmap(NULL, 2 * (size_t)capacity, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (out == NULL || buffers == MAP_FAILED) {
+    if (buffers != MAP_FAILED) {
+      munmap(buffers, 2 * (size_t)capacity);
+    }
+    free(out);
+    errno = errnoo;
+    return NULL;
+  }
+  out->buffers[0] = buffers;
+  out->buffers[1] = &buffers[capacity];
+  out->capacity = capacity;
+  out->count = 0;
+  out->index = 0;
+  out->fd = fd;
+  out->splice = true;
+  return out;
+}
+#endif
+
+#ifdef __linux__
+struct GaPcmIo *gapcm_io_uring(struct GaPcmIo *io, struct GaPcmIoUring *uring) {
+  io->PREFETCH = uring->output ? NULL : gapcm_io_uring_prefetch;
+  io->READ = uring->output ? NULL : gapcm_io_uring_read;
+  io->SEEK = uring->output ? NULL : gapcm_io_uring_seek;
+  io->TELL = gapcm_io_uring_tell;
+  io->WRITE = uring->output ? gapcm_io_uring_write : NULL;
+  io->user = uring;
+  return io;
+}
+
+bool gapcm_io_uring_flush(struct GaPcmIoUring *u) {
+  if (u->position > 0 && u->error == 0) {
+    gapcm_io_uring_queue(u, u->tail % GAPCM_IO_URING_BUFFERS, u->position);
+    u->tail++;
+    u->position = 0;
+  }
+  for (size_t index = 0; index < GAPCM_IO_URING_BUFFERS; index++) {
+    gapcm_io_uring_settle(u, &u->buffers[index]);
+  }
+  if (u->error != 0) {
+    errno = u->error;
+  }
+  return u->error == 0;
+}
+
+struct GaPcmIoUring *gapcm_io_uring_free(struct GaPcmIoUring *u) {
+  if (u == NULL) {
+    return NULL;
+  }
+  int errnoo = errno;
+  if (u->maps[2] != NULL) {
+    for (size_t index = 0; index < GAPCM_IO_URING_BUFFERS; index++) {
+      if (!gapcm_io_uring_reap(u, &u->buffers[index])) {
+        break;
+      }
+    }
+  }
+  if (u->ring_fd >= 0) {
+    close(u->ring_fd);
+  }
+  for (size_t index = 3; index-- > 0;) {
+    if (u->maps[index] != NULL &&
+        (index != 1 || u->maps[index] != u->maps[0])) {
+      munmap(u->maps[index], u->map_counts[index]);
+    }
+  }
+  if (u->buffers[0].bytes != NULL) {
+    munmap(u->buffers[0].bytes,
+           GAPCM_IO_URING_BUFFERS * GAPCM_IO_URING_BUFFER_BYTES);
+  }
+  free(u);
+  errno = errnoo;
+  return NULL;
+}
+
+struct GaPcmIoUring *gapcm_io_uring_make(const int fd,
+                                         const unsigned long long offset,
+                                         const bool output) {
+  int errnoo = errno;
+  struct stat status;
+  struct GaPcmIoUring *out = NULL;
+  struct io_uring_params params = {0};
+  if (fstat(fd, &status) != GAPCM_SUCCESS || !S_ISREG(status.st_mode) ||
+      (out = calloc(1, sizeof(*out))) == NULL) {
+    errno = errnoo;
+    return NULL;
+  }
+  out->fd = fd;
+  out->offset = offset;
+  out->output = output;
+  out->ring_fd =
+      syscall(__NR_io_uring_setup, GAPCM_IO_URING_BUFFERS, &params);
+  if (out->ring_fd < 0) {
+    return gapcm_io_uring_free(out);
+  }
+  out->map_counts[0] =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  out->map_counts[1] =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  out->map_counts[2] = params.sq_entries * sizeof(struct io_uring_sqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (out->map_counts[1] > out->map_counts[0]) {
+      out->map_counts[0] = out->map_counts[1];
+    }
+    out->map_counts[1] = out->map_counts[0];
+  }
+  const off_t offsets[] = {IORING_OFF_SQ_RING, IORING_OFF_CQ_RING,
+                           IORING_OFF_SQES};
+  for (size_t index = 0; index < 3; index++) {
+    if (index == 1 && params.features & IORING_FEAT_SINGLE_MMAP) {
+      out->maps[1] = out->maps[0];
+      continue;
+    }
+    void *map = mmap(NULL, out->map_counts[index], PROT_READ | PROT_WRITE,
+                     MAP_SHARED, out->ring_fd, offsets[index]);
+    if (map == MAP_FAILED) {
+      return gapcm_io_uring_free(out);
+    }
+    out->maps[index] = map;
+  }
+  uint8_t *sq = out->maps[0];
+  uint8_t *cq = out->maps[1];
+  out->sq_array = (unsigned *)&sq[params.sq_off.array];
+  out->sq_tail = (unsigned *)&sq[params.sq_off.tail];
+  out->sq_mask = *(unsigned *)&sq[params.sq_off.ring_mask];
+  out->cq_head = (unsigned *)&cq[params.cq_off.head];
+  out->cq_tail = (unsigned *)&cq[params.cq_off.tail];
+  out->cq_mask = *(unsigned *)&cq[params.cq_off.ring_mask];
+  out->cqes = (struct io_uring_cqe *)&cq[params.cq_off.cqes];
+  out->sqes = out->maps[2];
+  uint8_t *bytes =
+      mmap(NULL, GAPCM_IO_URING_BUFFERS * GAPCM_IO_URING_BUFFER_BYTES,
+           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (bytes == MAP_FAILED) {
+    return gapcm_io_uring_free(out);
+  }
+  struct iovec vectors[GAPCM_IO_URING_BUFFERS];
+  for (size_t index = 0; index < GAPCM_IO_URING_BUFFERS; index++) {
+    out->buffers[index].bytes = &bytes[GAPCM_IO_URING_BUFFER_BYTES * index];
+    vectors[index].iov_base = out->buffers[index].bytes;
+    vectors[index].iov_len = GAPCM_IO_URING_BUFFER_BYTES;
+  }
+  if (syscall(__NR_io_uring_register, out->ring_fd, IORING_REGISTER_BUFFERS,
+              vectors, GAPCM_IO_URING_BUFFERS) != GAPCM_SUCCESS) {
+    return gapcm_io_uring_free(out);
+  }
+  errno = errnoo;
+  return out;
+}
+#endif
@@ -0,0 +1,170 @@
+/**
+ * GAPCM: I/O Adapters
+ *
+ * Callback-based I/O that the transcode functions run on. Adapters wrap stdio
+ * files, file descriptors, and memory into it; other sources and outputs need
+ * only fill in the callbacks.
+ */
+#ifndef _GAPCM_IO_H
+#define _GAPCM_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Represents an I/O stream. Unused callbacks may be NULL. */
+struct GaPcmIo {
+  /**
+   * Reads up to the given count of bytes to the given location and returns the
+   * count read. Fewer means end-of-file or error.
+   */
+  size_t (*READ)(void *user, void *bytes, size_t count);
+  /**
+   * Writes the given count of bytes from the given location and returns the
+   * count written. Fewer means error.
+   */
+  size_t (*WRITE)(void *user, const void *bytes, size_t count);
+  /**
+   * Seeks to the given offset from the start and returns its success as `0`.
+   * Sets `errno` on error.
+   */
+  int (*SEEK)(void *user, unsigned long long offset);
+  /** Returns the current offset from the start, or `-1` on error. */
+  long long (*TELL)(void *user);
+  /**
+   * Hints that the given count of bytes from the given offset from the start
+   * are to be read soon, so that they may be read ahead.
+   */
+  void (*PREFETCH)(void *user, unsigned long long offset, size_t count);
+  /** User pointer passed to each callback. */
+  void *user;
+};
+
+/** Represents a pipe for the pipe adapter. */
+struct GaPcmIoPipe;
+
+/** Represents an io_uring stream for the io_uring adapter. */
+struct GaPcmIoUring;
+
+/** Represents memory for the memory adapter. */
+struct GaPcmIoMemory {
+  /** Bytes. Those of a read-only source are never written. */
+  uint8_t *bytes;
+  /** Count of bytes. Writes stop there. */
+  size_t count;
+  /** Current offset. */
+  size_t position;
+};
+
+#ifndef _WIN32
+/**
+ * Adapts the given file descriptor to the given I/O stream and returns the
+ * latter. Its position is shared with the descriptor.
+ */
+struct GaPcmIo *gapcm_io_fd(struct GaPcmIo *io, int fd);
+
+/**
+ * Repeats the given count of bytes before the given offset in the given file
+ * descriptor for the given count of times from the offset and returns the count
+ * of bytes written. On Linux, they are copied within the file by the kernel,
+ * which may share their storage instead. Elsewhere, or where that is
+ * unsupported, they are read and written back. The position of the descriptor
+ * is unchanged.
+ */
+unsigned long long gapcm_io_fd_repeat(int fd, long long offset,
+                                      unsigned long long count,
+                                      unsigned long long times);
+#endif
+
+/**
+ * Adapts the given file to the given I/O stream and returns the latter. Seeks
+ * flush first, see `gapcm_decode_seek`.
+ */
+struct GaPcmIo *gapcm_io_file(struct GaPcmIo *io, FILE *file);
+
+/**
+ * Adapts the given memory to the given I/O stream and returns the latter.
+ * Decoders take sectors from it in place.
+ */
+struct GaPcmIo *gapcm_io_memory(struct GaPcmIo *io,
+                                struct GaPcmIoMemory *memory);
+
+#ifndef _WIN32
+/**
+ * Maps the regular file of the given file descriptor read-only to the given
+ * memory from its start and returns its success. Sequential access is hinted
+ * and the file is read ahead. Fails without setting `errno` on pipes,
+ * terminals, and empty files; read those through another adapter.
+ */
+bool gapcm_io_memory_map(struct GaPcmIoMemory *memory, int fd);
+#endif
+
+/**
+ * Returns the memory of the given I/O stream if it is from `gapcm_io_memory`,
+ * or NULL otherwise.
+ */
+struct GaPcmIoMemory *gapcm_io_memory_of(const struct GaPcmIo *io);
+
+#ifndef _WIN32
+/** Unmaps the given memory from `gapcm_io_memory_map` and clears it. */
+void gapcm_io_memory_unmap(struct GaPcmIoMemory *memory);
+#endif
+
+#ifdef __linux__
+/**
+ * Adapts the given pipe to the given write-only I/O stream and returns the
+ * latter. Writes are copied to page-aligned buffers as large as the pipe, which
+ * are handed to it with `vmsplice` when full. Should that be unsupported, they
+ * are written instead.
+ */
+struct GaPcmIo *gapcm_io_pipe(struct GaPcmIo *io, struct GaPcmIoPipe *pipe);
+
+/**
+ * Hands the buffered bytes of the given pipe to it and returns its success.
+ * Call once after the last write; writes after it may change bytes still in the
+ * pipe.
+ */
+bool gapcm_io_pipe_flush(struct GaPcmIoPipe *pipe);
+
+/** Frees the given pipe without flushing it and returns NULL. */
+struct GaPcmIoPipe *gapcm_io_pipe_free(struct GaPcmIoPipe *pipe);
+
+/**
+ * Makes a pipe of the given file descriptor and returns it, or NULL if that is
+ * not of a pipe. The pipe is enlarged with `F_SETPIPE_SZ` where permitted.
+ */
+struct GaPcmIoPipe *gapcm_io_pipe_make(int fd);
+
+/**
+ * Adapts the given io_uring stream to the given I/O stream and returns the
+ * latter. A source keeps reads of the buffers ahead in flight; seeks change the
+ * offset of the next reads once those are reaped. An output submits each buffer
+ * once filled.
+ */
+struct GaPcmIo *gapcm_io_uring(struct GaPcmIo *io, struct GaPcmIoUring *uring);
+
+/**
+ * Submits the buffered bytes of the given io_uring output, waits for all of its
+ * writes, and returns their success. Sets `errno` of the first failure.
+ */
+bool gapcm_io_uring_flush(struct GaPcmIoUring *uring);
+
+/**
+ * Frees the given io_uring stream without flushing it and returns NULL. Waits
+ * for transfers in flight.
+ */
+struct GaPcmIoUring *gapcm_io_uring_free(struct GaPcmIoUring *uring);
+
+/**
+ * Makes an io_uring stream of the given file descriptor from the given offset
+ * for reading, or writing if the given flag is set, and returns it. Its buffers
+ * are registered with the ring. Returns NULL without setting `errno` if that is
+ * not of a regular file or io_uring is unavailable; use another adapter then.
+ * The descriptor offset is left as is.
+ */
+struct GaPcmIoUring *gapcm_io_uring_make(int fd, unsigned long long offset,
+                                         bool output);
+#endif
+
+#endif
@@ -0,0 +1,402 @@
+// Samples are mapped without branches. With the sign bit of a sign–magnitude
+// sample as mask `m`, `gapcm_decode_sample` equals `(s ^ (~m & 0x7f)) +
+// (GAPCM_SAMPLE_ORIGIN - 0x80)` modulo 256 for either origin. Encoding inverts
+// that on the clamped sample, whose offset `t = c + (0x80 -
+// GAPCM_SAMPLE_ORIGIN)` carries the mask instead: `t ^ (~m & 0x7f)`.
+
+#include "simd.h"
+#include "gapcm.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GAPCM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/** Count of sector bytes per block sample. */
+#define GAPCM_SIMD_STRIDE GAPCM_SECTOR_BLOCKS
+
+/** Decodes the sector samples from the given block index to the given count. */
+static size_t gapcm_simd_decode_tail(const uint8_t *restrict sector,
+                                     const size_t count,
+                                     uint8_t *restrict block, size_t index) {
+  for (; index < count / GAPCM_SIMD_STRIDE; index++) {
+    block[index] = gapcm_decode_sample(
+        sector[GAPCM_SIMD_STRIDE * index + GAPCM_SAMPLE_BYTES_PAD]);
+  }
+  return index;
+}
+
+/** Encodes the block samples from the given index to the given count. */
+static size_t gapcm_simd_encode_tail(const uint8_t *restrict block,
+                                     const size_t count,
+                                     uint8_t *restrict sector, size_t index) {
+  for (; index < count; index++) {
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+    sector[GAPCM_SIMD_STRIDE * index] = 0;
+#endif
+    sector[GAPCM_SIMD_STRIDE * index + GAPCM_SAMPLE_BYTES_PAD] =
+        gapcm_encode_sample(block[index]);
+  }
+  return GAPCM_SIMD_STRIDE * count;
+}
+
+/** Deinterleaves the block bytes from the given index to the given count. */
+static void gapcm_simd_deinterleave_tail(const uint8_t *restrict frames,
+                                         const size_t count,
+                                         uint8_t *restrict left,
+                                         uint8_t *restrict right,
+                                         size_t index) {
+  for (; index < count; index += GAPCM_SAMPLE_BYTES) {
+    memcpy(&left[index], &frames[2 * index], GAPCM_SAMPLE_BYTES);
+    memcpy(&right[index], &frames[2 * index + GAPCM_SAMPLE_BYTES],
+           GAPCM_SAMPLE_BYTES);
+  }
+}
+
+/** Interleaves the block bytes from the given index to the given count. */
+static void gapcm_simd_interleave_tail(const uint8_t *restrict left,
+                                       const uint8_t *restrict right,
+                                       const size_t count,
+                                       uint8_t *restrict frames,
+                                       size_t index) {
+  for (; index < count; index += GAPCM_SAMPLE_BYTES) {
+    memcpy(&frames[2 * index], &left[index], GAPCM_SAMPLE_BYTES);
+    memcpy(&frames[2 * index + GAPCM_SAMPLE_BYTES], &right[index],
+           GAPCM_SAMPLE_BYTES);
+  }
+}
+
+static bool gapcm_simd_supported_scalar(void) { return true; }
+
+#ifdef GAPCM_SIMD_X86
+/** Translates the given 16 sign–magnitude samples. */
+__attribute__((target("sse2"))) static inline __m128i
+gapcm_simd_decode_sse2(const __m128i samples) {
+  __m128i mask = _mm_cmpgt_epi8(_mm_setzero_si128(), samples);
+  return _mm_add_epi8(
+      _mm_xor_si128(samples, _mm_andnot_si128(mask, _mm_set1_epi8(0x7f))),
+      _mm_set1_epi8((char)(GAPCM_SAMPLE_ORIGIN - 0x80)));
+}
+
+/** Translates the given 32 sign–magnitude samples. */
+__attribute__((target("avx2"))) static inline __m256i
+gapcm_simd_decode_avx2(const __m256i samples) {
+  __m256i mask = _mm256_cmpgt_epi8(_mm256_setzero_si256(), samples);
+  return _mm256_add_epi8(
+      _mm256_xor_si256(samples,
+                       _mm256_andnot_si256(mask, _mm256_set1_epi8(0x7f))),
+      _mm256_set1_epi8((char)(GAPCM_SAMPLE_ORIGIN - 0x80)));
+}
+
+/** Clamps then translates the given 16 samples to sign–magnitude. */
+__attribute__((target("sse2"))) static inline __m128i
+gapcm_simd_encode_sse2(const __m128i samples) {
+  __m128i offset = _mm_add_epi8(
+      _mm_min_epu8(samples, _mm_set1_epi8((char)(GAPCM_SAMPLE_ORIGIN + 126))),
+      _mm_set1_epi8((char)(0x80 - GAPCM_SAMPLE_ORIGIN)));
+  __m128i mask = _mm_cmpgt_epi8(_mm_setzero_si128(), offset);
+  return _mm_xor_si128(offset, _mm_andnot_si128(mask, _mm_set1_epi8(0x7f)));
+}
+
+/** Clamps then translates the given 32 samples to sign–magnitude. */
+__attribute__((target("avx2"))) static inline __m256i
+gapcm_simd_encode_avx2(const __m256i samples) {
+  __m256i offset = _mm256_add_epi8(
+      _mm256_min_epu8(samples,
+                      _mm256_set1_epi8((char)(GAPCM_SAMPLE_ORIGIN + 126))),
+      _mm256_set1_epi8((char)(0x80 - GAPCM_SAMPLE_ORIGIN)));
+  __m256i mask = _mm256_cmpgt_epi8(_mm256_setzero_si256(), offset);
+  return _mm256_xor_si256(offset,
+                          _mm256_andnot_si256(mask, _mm256_set1_epi8(0x7f)));
+}
+
+__attribute__((target("sse2"))) static size_t
+gapcm_simd_decode_sector_sse2(const uint8_t *restrict sector,
+                              const size_t count, uint8_t *restrict block) {
+  size_t index = 0;
+  for (; index + 16 <= count / GAPCM_SIMD_STRIDE; index += 16) {
+    const uint8_t *in = &sector[GAPCM_SIMD_STRIDE * index];
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+    __m128i samples = _mm_packus_epi16(
+        _mm_srli_epi16(_mm_loadu_si128((const __m128i *)in), 8),
+        _mm_srli_epi16(_mm_loadu_si128((const __m128i *)&in[16]), 8));
+#else
+    __m128i samples = _mm_loadu_si128((const __m128i *)in);
+#endif
+    _mm_storeu_si128((__m128i *)&block[index],
+                     gapcm_simd_decode_sse2(samples));
+  }
+  return gapcm_simd_decode_tail(sector, count, block, index);
+}
+
+__attribute__((target("ssse3"))) static size_t
+gapcm_simd_decode_sector_ssse3(const uint8_t *restrict sector,
+                               const size_t count, uint8_t *restrict block) {
+  size_t index = 0;
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+  const __m128i odds = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -1, -1, -1,
+                                     -1, -1, -1, -1, -1);
+#endif
+  for (; index + 16 <= count / GAPCM_SIMD_STRIDE; index += 16) {
+    const uint8_t *in = &sector[GAPCM_SIMD_STRIDE * index];
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+    __m128i samples = _mm_unpacklo_epi64(
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), odds),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&in[16]), odds));
+#else
+    __m128i samples = _mm_loadu_si128((const __m128i *)in);
+#endif
+    _mm_storeu_si128((__m128i *)&block[index],
+                     gapcm_simd_decode_sse2(samples));
+  }
+  return gapcm_simd_decode_tail(sector, count, block, index);
+}
+
+__attribute__((target("avx2"))) static size_t
+gapcm_simd_decode_sector_avx2(const uint8_t *restrict sector,
+                              const size_t count, uint8_t *restrict block) {
+  size_t index = 0;
+  for (; index + 32 <= count / GAPCM_SIMD_STRIDE; index += 32) {
+    const uint8_t *in = &sector[GAPCM_SIMD_STRIDE * index];
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+    // Packing is per 128-bit lane, so restore the quadword order after.
+    __m256i samples = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(
+            _mm256_srli_epi16(_mm256_loadu_si256((const __m256i *)in), 8),
+            _mm256_srli_epi16(_mm256_loadu_si256((const __m256i *)&in[32]),
+                              8)),
+        0xd8);
+#else
+    __m256i samples = _mm256_loadu_si256((const __m256i *)in);
+#endif
+    _mm256_storeu_si256((__m256i *)&block[index],
+                        gapcm_simd_decode_avx2(samples));
+  }
+  return gapcm_simd_decode_tail(sector, count, block, index);
+}
+
+__attribute__((target("sse2"))) static size_t
+gapcm_simd_encode_sector_sse2(const uint8_t *restrict block,
+                              const size_t count, uint8_t *restrict sector) {
+  size_t index = 0;
+  for (; index + 16 <= count; index += 16) {
+    __m128i samples = gapcm_simd_encode_sse2(
+        _mm_loadu_si128((const __m128i *)&block[index]));
+    __m128i *out = (__m128i *)&sector[GAPCM_SIMD_STRIDE * index];
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+    _mm_storeu_si128(out, _mm_unpacklo_epi8(_mm_setzero_si128(), samples));
+    _mm_storeu_si128(&out[1], _mm_unpackhi_epi8(_mm_setzero_si128(), samples));
+#else
+    _mm_storeu_si128(out, samples);
+#endif
+  }
+  return gapcm_simd_encode_tail(block, count, sector, index);
+}
+
+__attribute__((target("avx2"))) static size_t
+gapcm_simd_encode_sector_avx2(const uint8_t *restrict block,
+                              const size_t count, uint8_t *restrict sector) {
+  size_t index = 0;
+  for (; index + 32 <= count; index += 32) {
+    __m256i samples = gapcm_simd_encode_avx2(
+        _mm256_loadu_si256((const __m256i *)&block[index]));
+    __m256i *out = (__m256i *)&sector[GAPCM_SIMD_STRIDE * index];
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+    // Unpacking is per 128-bit lane, so pair the quadwords up before.
+    samples = _mm256_permute4x64_epi64(samples, 0xd8);
+    _mm256_storeu_si256(out,
+                        _mm256_unpacklo_epi8(_mm256_setzero_si256(), samples));
+    _mm256_storeu_si256(&out[1],
+                        _mm256_unpackhi_epi8(_mm256_setzero_si256(), samples));
+#else
+    _mm256_storeu_si256(out, samples);
+#endif
+  }
+  return gapcm_simd_encode_tail(block, count, sector, index);
+}
+
+__attribute__((target("sse2"))) static void
+gapcm_simd_deinterleave_sse2(const uint8_t *restrict frames,
+                             const size_t count, uint8_t *restrict left,
+                             uint8_t *restrict right) {
+  size_t index = 0;
+  for (; index + 16 <= count; index += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)&frames[2 * index]);
+    __m128i b = _mm_loadu_si128((const __m128i *)&frames[2 * index + 16]);
+#if GAPCM_SAMPLE_BYTES == 1
+    __m128i mask = _mm_set1_epi16(0xff);
+    __m128i l =
+        _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+    __m128i r = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+#else
+    // Sign extension keeps the signed pack from saturating.
+    __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    __m128i r = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+#endif
+    _mm_storeu_si128((__m128i *)&left[index], l);
+    _mm_storeu_si128((__m128i *)&right[index], r);
+  }
+  gapcm_simd_deinterleave_tail(frames, count, left, right, index);
+}
+
+__attribute__((target("avx2"))) static void
+gapcm_simd_deinterleave_avx2(const uint8_t *restrict frames,
+                             const size_t count, uint8_t *restrict left,
+                             uint8_t *restrict right) {
+  size_t index = 0;
+  for (; index + 32 <= count; index += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)&frames[2 * index]);
+    __m256i b = _mm256_loadu_si256((const __m256i *)&frames[2 * index + 32]);
+#if GAPCM_SAMPLE_BYTES == 1
+    __m256i mask = _mm256_set1_epi16(0xff);
+    __m256i l = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                    _mm256_and_si256(b, mask));
+    __m256i r =
+        _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+#else
+    __m256i l =
+        _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+                           _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+    __m256i r =
+        _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+#endif
+    _mm256_storeu_si256((__m256i *)&left[index],
+                        _mm256_permute4x64_epi64(l, 0xd8));
+    _mm256_storeu_si256((__m256i *)&right[index],
+                        _mm256_permute4x64_epi64(r, 0xd8));
+  }
+  gapcm_simd_deinterleave_tail(frames, count, left, right, index);
+}
+
+__attribute__((target("sse2"))) static void
+gapcm_simd_interleave_sse2(const uint8_t *restrict left,
+                           const uint8_t *restrict right, const size_t count,
+                           uint8_t *restrict frames) {
+  size_t index = 0;
+  for (; index + 16 <= count; index += 16) {
+    __m128i l = _mm_loadu_si128((const __m128i *)&left[index]);
+    __m128i r = _mm_loadu_si128((const __m128i *)&right[index]);
+    __m128i *out = (__m128i *)&frames[2 * index];
+#if GAPCM_SAMPLE_BYTES == 1
+    _mm_storeu_si128(out, _mm_unpacklo_epi8(l, r));
+    _mm_storeu_si128(&out[1], _mm_unpackhi_epi8(l, r));
+#else
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(l, r));
+    _mm_storeu_si128(&out[1], _mm_unpackhi_epi16(l, r));
+#endif
+  }
+  gapcm_simd_interleave_tail(left, right, count, frames, index);
+}
+
+__attribute__((target("avx2"))) static void
+gapcm_simd_interleave_avx2(const uint8_t *restrict left,
+                           const uint8_t *restrict right, const size_t count,
+                           uint8_t *restrict frames) {
+  size_t index = 0;
+  for (; index + 32 <= count; index += 32) {
+    __m256i l = _mm256_permute4x64_epi64(
+        _mm256_loadu_si256((const __m256i *)&left[index]), 0xd8);
+    __m256i r = _mm256_permute4x64_epi64(
+        _mm256_loadu_si256((const __m256i *)&right[index]), 0xd8);
+    __m256i *out = (__m256i *)&frames[2 * index];
+#if GAPCM_SAMPLE_BYTES == 1
+    _mm256_storeu_si256(out, _mm256_unpacklo_epi8(l, r));
+    _mm256_storeu_si256(&out[1], _mm256_unpackhi_epi8(l, r));
+#else
+    _mm256_storeu_si256(out, _mm256_unpacklo_epi16(l, r));
+    _mm256_storeu_si256(&out[1], _mm256_unpackhi_epi16(l, r));
+#endif
+  }
+  gapcm_simd_interleave_tail(left, right, count, frames, index);
+}
+
+static bool gapcm_simd_supported_avx2(void) {
+  return __builtin_cpu_supports("avx2");
+}
+
+static bool gapcm_simd_supported_sse2(void) {
+  return __builtin_cpu_supports("sse2");
+}
+
+static bool gapcm_simd_supported_ssse3(void) {
+  return __builtin_cpu_supports("ssse3");
+}
+#endif
+
+const struct GaPcmSimdKernel gapcm_simd_kernels[] = {
+#ifdef GAPCM_SIMD_X86
+    {"avx2", gapcm_simd_supported_avx2, gapcm_simd_decode_sector_avx2,
+     gapcm_simd_encode_sector_avx2, gapcm_simd_interleave_avx2,
+     gapcm_simd_deinterleave_avx2},
+    {"ssse3", gapcm_simd_supported_ssse3, gapcm_simd_decode_sector_ssse3,
+     gapcm_simd_encode_sector_sse2, gapcm_simd_interleave_sse2,
+     gapcm_simd_deinterleave_sse2},
+    {"sse2", gapcm_simd_supported_sse2, gapcm_simd_decode_sector_sse2,
+     gapcm_simd_encode_sector_sse2, gapcm_simd_interleave_sse2,
+     gapcm_simd_deinterleave_sse2},
+#endif
+    {"scalar", gapcm_simd_supported_scalar, gapcm_simd_decode_sector,
+     gapcm_simd_encode_sector, gapcm_simd_interleave,
+     gapcm_simd_deinterleave}};
+
+const size_t gapcm_simd_kernel_count =
+    sizeof(gapcm_simd_kernels) / sizeof(*gapcm_simd_kernels);
+
+/** Selected kernel. The reference is used until selection. */
+static const struct GaPcmSimdKernel *gapcm_simd_selection =
+    &gapcm_simd_kernels[sizeof(gapcm_simd_kernels) /
+                            sizeof(*gapcm_simd_kernels) -
+                        1];
+
+/** Selects the most preferred kernel that this processor supports. */
+__attribute__((constructor)) static void gapcm_simd_select(void) {
+#ifdef GAPCM_SIMD_X86
+  __builtin_cpu_init();
+#endif
+  for (size_t index = 0; index < gapcm_simd_kernel_count; index++) {
+    if (gapcm_simd_kernels[index].SUPPORTED()) {
+      gapcm_simd_selection = &gapcm_simd_kernels[index];
+      break;
+    }
+  }
+}
+
+const struct GaPcmSimdKernel *gapcm_simd_kernel(void) {
+  return gapcm_simd_selection;
+}
+
+size_t gapcm_simd_decode_sector(const uint8_t *restrict sector,
+                                const size_t count, uint8_t *restrict block) {
+  size_t out = 0;
+  for (size_t offset = GAPCM_SAMPLE_BYTES_PAD; offset < count;
+       offset = ++out * GAPCM_SECTOR_BLOCKS + GAPCM_SAMPLE_BYTES_PAD) {
+    block[out] = gapcm_decode_sample(sector[offset]);
+  }
+  return out;
+}
+
+size_t gapcm_simd_encode_sector(const uint8_t *restrict block,
+                                const size_t count, uint8_t *restrict sector) {
+  size_t out = 0;
+  for (size_t index = 0; index < count; out = ++index * GAPCM_SECTOR_BLOCKS) {
+#if GAPCM_SAMPLE_BYTES_PAD == 1
+    sector[out] = 0;
+#endif
+    sector[out + GAPCM_SAMPLE_BYTES_PAD] = gapcm_encode_sample(block[index]);
+  }
+  return out;
+}
+
+void gapcm_simd_deinterleave(const uint8_t *restrict frames,
+                             const size_t count, uint8_t *restrict left,
+                             uint8_t *restrict right) {
+  gapcm_simd_deinterleave_tail(frames, count, left, right, 0);
+}
+
+void gapcm_simd_interleave(const uint8_t *restrict left,
+                           const uint8_t *restrict right, const size_t count,
+                           uint8_t *restrict frames) {
+  gapcm_simd_interleave_tail(left, right, count, frames, 0);
+}
@@ -0,0 +1,62 @@
+/**
+ * GAPCM: Sector Kernels
+ *
+ * Vectorized counterparts of the sector transcode functions. Each kernel is
+ * bit-exact with its scalar reference, which is also the fallback for
+ * processors or compilers without vector support. The fastest kernel that the
+ * processor supports is selected once at startup.
+ */
+#ifndef _GAPCM_SIMD_H
+#define _GAPCM_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Represents a set of sector kernels for one instruction set. */
+struct GaPcmSimdKernel {
+  /** Instruction set name. */
+  const char *NAME;
+  /** Returns whether this processor supports the instruction set. */
+  bool (*SUPPORTED)(void);
+  /** Sector decoder. See `gapcm_decode_sector`. */
+  size_t (*DECODE)(const uint8_t *sector, size_t count, uint8_t *block);
+  /** Sector encoder. See `gapcm_encode_sector`. */
+  size_t (*ENCODE)(const uint8_t *block, size_t count, uint8_t *sector);
+  /**
+   * Stereo interleaver. Writes the given count of bytes from each given block
+   * as frames, where the count is a multiple of `GAPCM_SAMPLE_BYTES`.
+   */
+  void (*INTERLEAVE)(const uint8_t *left, const uint8_t *right, size_t count,
+                     uint8_t *frames);
+  /** Stereo deinterleaver. The reverse of `INTERLEAVE`. */
+  void (*DEINTERLEAVE)(const uint8_t *frames, size_t count, uint8_t *left,
+                       uint8_t *right);
+};
+
+/** Kernels from the most to the least preferred, ending with the reference. */
+extern const struct GaPcmSimdKernel gapcm_simd_kernels[];
+
+/** Count of kernels in `gapcm_simd_kernels`. */
+extern const size_t gapcm_simd_kernel_count;
+
+/** Returns the kernel selected for this processor. */
+const struct GaPcmSimdKernel *gapcm_simd_kernel(void);
+
+/** Scalar reference sector decoder. See `gapcm_decode_sector`. */
+size_t gapcm_simd_decode_sector(const uint8_t *sector, size_t count,
+                                uint8_t *block);
+
+/** Scalar reference sector encoder. See `gapcm_encode_sector`. */
+size_t gapcm_simd_encode_sector(const uint8_t *block, size_t count,
+                                uint8_t *sector);
+
+/** Scalar reference stereo deinterleaver. */
+void gapcm_simd_deinterleave(const uint8_t *frames, size_t count,
+                             uint8_t *left, uint8_t *right);
+
+/** Scalar reference stereo interleaver. */
+void gapcm_simd_interleave(const uint8_t *left, const uint8_t *right,
+                           size_t count, uint8_t *frames);
+
+#endif